@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+namespace quasi_succinct {
+
+    // Estimated time in nanoseconds to traverse a sequence, by encoding.
+    // Used by the space-time partitioning mode, where a partition costs
+    // bits + lambda * ns (see global_parameters::space_time_lambda). The
+    // defaults were measured with calibrate_access_time, which should be
+    // rerun on the target machine.
+    struct access_time_model {
+        access_time_model()
+            : ef_ns(3.0)
+            , rb_ns(1.0)
+            , rb_word_ns(11.0)
+            , all_ones_ns(0.4)
+            , partition_ns(100.0)
+        {}
+
+        double elias_fano(uint64_t /* universe */, uint64_t n) const
+        {
+            return ef_ns * n;
+        }
+
+        double ranked_bitvector(uint64_t universe, uint64_t n) const
+        {
+            return rb_ns * n + rb_word_ns * (universe / 64);
+        }
+
+        double all_ones(uint64_t /* universe */, uint64_t n) const
+        {
+            return all_ones_ns * n;
+        }
+
+        double ef_ns; // per element
+        double rb_ns; // per element
+        double rb_word_ns; // per 64 bits of universe
+        double all_ones_ns; // per element
+        double partition_ns; // per partition switch
+    };
+
+    // time term of the space-time cost, in bits
+    inline uint64_t time_cost(double lambda, double ns)
+    {
+        return uint64_t(lambda * ns + 0.5);
+    }
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <succinct/broadword.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define QS_AVX2_DISPATCH 1
+#   include <immintrin.h>
+#endif
+
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Scans over raw bit vector words used by the dense sequences. Each
+    // operation has a portable word-at-a-time version and, on x86, an AVX2
+    // version that processes 4 words at a time; the plain functions pick
+    // one at runtime depending on the CPU, so the binary does not need to
+    // be built with -mavx2.
+    namespace bit_scan {
+
+        // number of ones in the bits [begin, end) of data
+        inline uint64_t popcount_scalar(uint64_t const* data,
+                                        uint64_t begin, uint64_t end)
+        {
+            using succinct::broadword::popcount;
+            if (begin >= end) return 0;
+
+            uint64_t begin_word = begin / 64;
+            uint64_t end_word = end / 64;
+            uint64_t word = (data[begin_word] >> (begin % 64)) << (begin % 64);
+            uint64_t ret = 0;
+            while (begin_word < end_word) {
+                ret += popcount(word);
+                word = data[++begin_word];
+            }
+            if (end % 64) {
+                ret += popcount(word << (64 - end % 64));
+            }
+            return ret;
+        }
+
+        // position of the first one at or after pos; there must be one
+        // before end
+        inline uint64_t next_one_scalar(uint64_t const* data,
+                                        uint64_t pos, uint64_t end)
+        {
+            (void)end;
+            uint64_t w = pos / 64;
+            uint64_t word = data[w] & (uint64_t(-1) << (pos % 64));
+            while (!word) {
+                assert((w + 1) * 64 < end);
+                word = data[++w];
+            }
+            return w * 64 + succinct::broadword::lsb(word);
+        }
+
+        // the 256 bits of a starting at bit a_pos ANDed with those of b
+        // starting at bit b_pos, into out; the word after each range must
+        // be readable
+        inline void and_256_scalar(uint64_t const* a, uint64_t a_pos,
+                                   uint64_t const* b, uint64_t b_pos,
+                                   uint64_t* out)
+        {
+            uint64_t a_word = a_pos / 64, a_shift = a_pos % 64;
+            uint64_t b_word = b_pos / 64, b_shift = b_pos % 64;
+            for (size_t w = 0; w < 4; ++w) {
+                uint64_t x = a[a_word + w] >> a_shift;
+                if (a_shift) x |= a[a_word + w + 1] << (64 - a_shift);
+                uint64_t y = b[b_word + w] >> b_shift;
+                if (b_shift) y |= b[b_word + w + 1] << (64 - b_shift);
+                out[w] = x & y;
+            }
+        }
+
+#if QS_AVX2_DISPATCH
+
+        // per-byte popcount via nibble lookup, summed into 4 64-bit lanes
+        __attribute__((target("avx2")))
+        inline __m256i popcount256(__m256i v)
+        {
+            const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                                    1, 2, 2, 3, 2, 3, 3, 4,
+                                                    0, 1, 1, 2, 1, 2, 2, 3,
+                                                    1, 2, 2, 3, 2, 3, 3, 4);
+            const __m256i low_mask = _mm256_set1_epi8(0x0f);
+            __m256i lo = _mm256_and_si256(v, low_mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+            __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                          _mm256_shuffle_epi8(lookup, hi));
+            return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+        }
+
+        __attribute__((target("avx2")))
+        inline uint64_t popcount_avx2(uint64_t const* data,
+                                      uint64_t begin, uint64_t end)
+        {
+            using succinct::broadword::popcount;
+            if (begin >= end) return 0;
+
+            uint64_t begin_word = begin / 64;
+            uint64_t end_word = end / 64;
+            if (end_word - begin_word < 5) {
+                return popcount_scalar(data, begin, end);
+            }
+
+            uint64_t ret = popcount((data[begin_word] >> (begin % 64)) << (begin % 64));
+            uint64_t w = begin_word + 1;
+            __m256i acc = _mm256_setzero_si256();
+            for (; w + 4 <= end_word; w += 4) {
+                __m256i v = _mm256_loadu_si256((__m256i const*)(data + w));
+                acc = _mm256_add_epi64(acc, popcount256(v));
+            }
+            ret += uint64_t(_mm256_extract_epi64(acc, 0)) + uint64_t(_mm256_extract_epi64(acc, 1))
+                + uint64_t(_mm256_extract_epi64(acc, 2)) + uint64_t(_mm256_extract_epi64(acc, 3));
+            for (; w < end_word; ++w) {
+                ret += popcount(data[w]);
+            }
+            if (end % 64) {
+                ret += popcount(data[end_word] << (64 - end % 64));
+            }
+            return ret;
+        }
+
+        __attribute__((target("avx2,bmi")))
+        inline uint64_t next_one_avx2(uint64_t const* data,
+                                      uint64_t pos, uint64_t end)
+        {
+            uint64_t w = pos / 64;
+            uint64_t word = data[w] & (uint64_t(-1) << (pos % 64));
+            if (word) {
+                return w * 64 + _tzcnt_u64(word);
+            }
+
+            // words are loaded only if they lie entirely before end
+            uint64_t end_word = (end + 63) / 64;
+            ++w;
+            for (; w + 4 <= end_word; w += 4) {
+                __m256i v = _mm256_loadu_si256((__m256i const*)(data + w));
+                if (!_mm256_testz_si256(v, v)) break;
+            }
+            while (!data[w]) {
+                assert(w + 1 < end_word);
+                ++w;
+            }
+            return w * 64 + _tzcnt_u64(data[w]);
+        }
+
+        // 256 bits starting at bit pos, from two overlapping unaligned
+        // loads; a shift by 64 gives zero, so pos % 64 == 0 needs no
+        // special case
+        __attribute__((target("avx2")))
+        inline __m256i load_bits256(uint64_t const* data, uint64_t pos)
+        {
+            __m128i shift = _mm_cvtsi64_si128(pos % 64);
+            __m128i rshift = _mm_cvtsi64_si128(64 - pos % 64);
+            __m256i lo = _mm256_loadu_si256((__m256i const*)(data + pos / 64));
+            __m256i hi = _mm256_loadu_si256((__m256i const*)(data + pos / 64 + 1));
+            return _mm256_or_si256(_mm256_srl_epi64(lo, shift),
+                                   _mm256_sll_epi64(hi, rshift));
+        }
+
+        __attribute__((target("avx2")))
+        inline void and_256_avx2(uint64_t const* a, uint64_t a_pos,
+                                 uint64_t const* b, uint64_t b_pos,
+                                 uint64_t* out)
+        {
+            __m256i v = _mm256_and_si256(load_bits256(a, a_pos),
+                                         load_bits256(b, b_pos));
+            _mm256_storeu_si256((__m256i*)out, v);
+        }
+
+        inline bool has_avx2()
+        {
+            static const bool ret = __builtin_cpu_supports("avx2")
+                && __builtin_cpu_supports("bmi");
+            return ret;
+        }
+
+        inline uint64_t popcount(uint64_t const* data,
+                                 uint64_t begin, uint64_t end)
+        {
+            return has_avx2()
+                ? popcount_avx2(data, begin, end)
+                : popcount_scalar(data, begin, end);
+        }
+
+        inline uint64_t next_one(uint64_t const* data,
+                                 uint64_t pos, uint64_t end)
+        {
+            return has_avx2()
+                ? next_one_avx2(data, pos, end)
+                : next_one_scalar(data, pos, end);
+        }
+
+        inline void and_256(uint64_t const* a, uint64_t a_pos,
+                            uint64_t const* b, uint64_t b_pos,
+                            uint64_t* out)
+        {
+            if (has_avx2()) {
+                and_256_avx2(a, a_pos, b, b_pos, out);
+            } else {
+                and_256_scalar(a, a_pos, b, b_pos, out);
+            }
+        }
+
+#else
+
+        inline bool has_avx2()
+        {
+            return false;
+        }
+
+        inline uint64_t popcount(uint64_t const* data,
+                                 uint64_t begin, uint64_t end)
+        {
+            return popcount_scalar(data, begin, end);
+        }
+
+        inline uint64_t next_one(uint64_t const* data,
+                                 uint64_t pos, uint64_t end)
+        {
+            return next_one_scalar(data, pos, end);
+        }
+
+        inline void and_256(uint64_t const* a, uint64_t a_pos,
+                            uint64_t const* b, uint64_t b_pos,
+                            uint64_t* out)
+        {
+            and_256_scalar(a, a_pos, b, b_pos, out);
+        }
+
+#endif
+    }
+}
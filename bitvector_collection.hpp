@@ -32,9 +32,17 @@ namespace quasi_succinct {
                 succinct::bit_vector(&m_bitvectors).swap(sq.m_bitvectors);
 
                 succinct::bit_vector_builder bvb;
-                compact_elias_fano::write(bvb, m_endpoints.begin(),
-                                          m_bitvectors.size(), sq.m_size,
-                                          m_params);
+                if (m_params.flat_endpoints) {
+                    uint64_t width = endpoint_bits(m_bitvectors.size());
+                    bvb.reserve(sq.m_size * width);
+                    for (size_t i = 0; i < sq.m_size; ++i) {
+                        bvb.append_bits(m_endpoints[i], width);
+                    }
+                } else {
+                    compact_elias_fano::write(bvb, m_endpoints.begin(),
+                                              m_bitvectors.size(), sq.m_size,
+                                              m_params);
+                }
                 succinct::bit_vector(&bvb).swap(sq.m_endpoints);
             }
 
@@ -58,12 +66,20 @@ namespace quasi_succinct {
         get(global_parameters const& params, size_t i) const
         {
             assert(i < size());
-            compact_elias_fano::enumerator endpoints(m_endpoints, 0,
-                                                     m_bitvectors.size(), m_size,
-                                                     params);
+            return succinct::bit_vector::enumerator(m_bitvectors, endpoint(params, i));
+        }
+
+        // position past the last bit of the i-th bitvector
+        uint64_t end_position(global_parameters const& params, size_t i) const
+        {
+            assert(i < size());
+            return i + 1 < size() ? endpoint(params, i + 1) : m_bitvectors.size();
+        }
 
-            auto endpoint = endpoints.move(i).second;
-            return succinct::bit_vector::enumerator(m_bitvectors, endpoint);
+        // width of the fixed-width endpoints used when params.flat_endpoints
+        static uint64_t endpoint_bits(uint64_t universe)
+        {
+            return ceil_log2(universe + 1);
         }
 
         void swap(bitvector_collection& other)
@@ -84,6 +100,18 @@ namespace quasi_succinct {
         }
 
     private:
+        uint64_t endpoint(global_parameters const& params, size_t i) const
+        {
+            if (params.flat_endpoints) {
+                uint64_t width = endpoint_bits(m_bitvectors.size());
+                return m_endpoints.get_bits(i * width, width);
+            }
+            compact_elias_fano::enumerator endpoints(m_endpoints, 0,
+                                                     m_bitvectors.size(), m_size,
+                                                     params);
+            return endpoints.move(i).second;
+        }
+
         size_t m_size;
         succinct::bit_vector m_endpoints;
         succinct::bit_vector m_bitvectors;
@@ -116,6 +116,11 @@ namespace quasi_succinct {
                 const uint32_t encodedExceptionsSize = *in & ((1 << PFORDELTA_EXCEPTSZ)
                                                               - 1);
 
+                // the exceptions are decoded in a local buffer rather than
+                // in the exceptions member, so that the (static) codec can
+                // decode in several threads; the size is that of
+                // OPTPFor::exceptions, as the decoder may write past the end
+                uint32_t exceptions[4 * BlockSize + 1024 + 1];
                 size_t twonexceptions = 2 * nExceptions;
                 ++in;
                 if (encodedExceptionsSize > 0)
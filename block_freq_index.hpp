@@ -4,6 +4,7 @@
 #include <succinct/bit_vector.hpp>
 
 #include "compact_elias_fano.hpp"
+#include "bitvector_collection.hpp"
 #include "block_posting_list.hpp"
 
 namespace quasi_succinct {
@@ -29,7 +30,8 @@ namespace quasi_succinct {
             {
                 if (!n) throw std::invalid_argument("List must be nonempty");
                 block_posting_list<BlockCodec>::write(m_lists, n,
-                                                      docs_begin, freqs_begin);
+                                                      unwrap_iterator(docs_begin),
+                                                      unwrap_iterator(freqs_begin));
                 m_endpoints.push_back(m_lists.size());
             }
 
@@ -41,9 +43,16 @@ namespace quasi_succinct {
                 sq.m_lists.steal(m_lists);
 
                 succinct::bit_vector_builder bvb;
-                compact_elias_fano::write(bvb, m_endpoints.begin(),
-                                          sq.m_lists.size(), sq.m_size,
-                                          m_params); // XXX
+                if (m_params.flat_endpoints) {
+                    uint64_t width = bitvector_collection::endpoint_bits(sq.m_lists.size());
+                    for (size_t i = 0; i < sq.m_size; ++i) {
+                        bvb.append_bits(m_endpoints[i], width);
+                    }
+                } else {
+                    compact_elias_fano::write(bvb, m_endpoints.begin(),
+                                              sq.m_lists.size(), sq.m_size,
+                                              m_params); // XXX
+                }
                 succinct::bit_vector(&bvb).swap(sq.m_endpoints);
             }
 
@@ -69,11 +78,16 @@ namespace quasi_succinct {
         document_enumerator operator[](size_t i) const
         {
             assert(i < size());
-            compact_elias_fano::enumerator endpoints(m_endpoints, 0,
-                                                     m_lists.size(), m_size,
-                                                     m_params);
-
-            auto endpoint = endpoints.move(i).second;
+            uint64_t endpoint;
+            if (m_params.flat_endpoints) {
+                uint64_t width = bitvector_collection::endpoint_bits(m_lists.size());
+                endpoint = m_endpoints.get_bits(i * width, width);
+            } else {
+                compact_elias_fano::enumerator endpoints(m_endpoints, 0,
+                                                         m_lists.size(), m_size,
+                                                         m_params);
+                endpoint = endpoints.move(i).second;
+            }
             return document_enumerator(m_lists.data() + endpoint, num_docs());
         }
 
@@ -2,6 +2,7 @@
 
 #include "succinct/util.hpp"
 #include "block_codecs.hpp"
+#include "query_counters.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -74,6 +75,7 @@ namespace quasi_succinct {
 
             void QS_ALWAYSINLINE next()
             {
+                QS_COUNT(next);
                 ++m_pos_in_block;
                 if (QS_UNLIKELY(m_pos_in_block == m_cur_block_size)) {
                     if (m_cur_block + 1 == m_blocks) {
@@ -88,6 +90,7 @@ namespace quasi_succinct {
 
             void QS_ALWAYSINLINE next_geq(uint64_t lower_bound)
             {
+                QS_COUNT(next_geq);
                 assert(lower_bound >= m_cur_docid);
                 if (QS_UNLIKELY(lower_bound > m_cur_block_max)) {
                     // binary search seems to perform worse here
@@ -177,6 +180,7 @@ namespace quasi_succinct {
 
             void QS_NOINLINE decode_docs_block(uint64_t block)
             {
+                QS_COUNT(block_decodes);
                 static const uint64_t block_size = BlockCodec::block_size;
                 uint32_t endpoint = block
                     ? ((uint32_t const*)m_block_endpoints)[block - 1]
@@ -202,6 +206,7 @@ namespace quasi_succinct {
 
             void QS_NOINLINE decode_freqs_block()
             {
+                QS_COUNT(block_decodes);
                 BlockCodec::decode(m_freqs_block_data, m_freqs_buf.data(),
                                    uint32_t(-1), m_cur_block_size);
                 m_freqs_decoded = true;
@@ -9,9 +9,21 @@ namespace quasi_succinct {
         static constexpr float k1 = 1.2;
 
         static float doc_term_weight(uint64_t freq, float norm_len)
+        {
+            return doc_term_weight_from_factor(freq, len_factor(norm_len));
+        }
+
+        // The weight split in a per-document part, which can be
+        // precomputed, and a per-posting part
+        static float len_factor(float norm_len)
+        {
+            return k1 * (1.0f - b + b * norm_len);
+        }
+
+        static float doc_term_weight_from_factor(uint64_t freq, float len_factor)
         {
             float f = (float)freq;
-            return f / (f + k1 * (1.0f - b + b * norm_len));
+            return f / (f + len_factor);
         }
 
         static float query_term_weight(uint64_t freq, uint64_t df, uint64_t num_docs)
@@ -0,0 +1,225 @@
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include <succinct/bit_vector.hpp>
+
+#include "configuration.hpp"
+#include "binary_freq_collection.hpp"
+#include "partitioned_sequence.hpp"
+#include "util.hpp"
+
+using namespace quasi_succinct;
+
+// Measures the coefficients of access_time_model on this machine and, if
+// a collection is given, reports the space/estimated-time curve of the
+// space-time partitioning for several values of lambda.
+
+std::vector<uint64_t> random_sequence(uint64_t universe, uint64_t n,
+                                      std::mt19937_64& rng)
+{
+    // n distinct sorted values in [0, universe)
+    std::vector<uint64_t> seq;
+    std::uniform_real_distribution<double> coin(0, 1);
+    for (uint64_t v = 0; v < universe && seq.size() < n; ++v) {
+        if (coin(rng) * (universe - v) < n - seq.size()) {
+            seq.push_back(v);
+        }
+    }
+    return seq;
+}
+
+template <typename Enumerator>
+double traversal_ns(Enumerator e, uint64_t n, size_t runs = 5)
+{
+    double best = std::numeric_limits<double>::max();
+    for (size_t run = 0; run < runs; ++run) {
+        e.move(0);
+        uint64_t checksum = 0;
+        auto tick = get_time_usecs();
+        for (uint64_t i = 1; i < n; ++i) {
+            checksum += e.next().second;
+        }
+        do_not_optimize_away(checksum);
+        best = std::min(best, (get_time_usecs() - tick) * 1000);
+    }
+    return best;
+}
+
+template <typename Sequence>
+double sequence_ns(std::vector<uint64_t> const& seq, uint64_t universe,
+                   global_parameters const& params)
+{
+    succinct::bit_vector_builder bvb;
+    Sequence::write(bvb, seq.begin(), universe, seq.size(), params);
+    succinct::bit_vector bv(&bvb);
+    typename Sequence::enumerator e(bv, 0, universe, seq.size(), params);
+    return traversal_ns(e, seq.size());
+}
+
+access_time_model calibrate()
+{
+    global_parameters params;
+    access_time_model model;
+    std::mt19937_64 rng(1729);
+    uint64_t n = 1 << 20;
+
+    auto ef_seq = random_sequence(16 * n, n, rng);
+    model.ef_ns = sequence_ns<compact_elias_fano>(ef_seq, 16 * n, params) / n;
+
+    // two densities to separate the per-element and per-word costs
+    auto dense_seq = random_sequence(2 * n, n, rng);
+    auto sparse_seq = random_sequence(8 * n, n, rng);
+    double dense_ns = sequence_ns<compact_ranked_bitvector>(dense_seq, 2 * n, params);
+    double sparse_ns = sequence_ns<compact_ranked_bitvector>(sparse_seq, 8 * n, params);
+    double dense_words = 2.0 * n / 64, sparse_words = 8.0 * n / 64;
+    model.rb_word_ns = std::max(0.0, (sparse_ns - dense_ns) / (sparse_words - dense_words));
+    model.rb_ns = std::max(0.0, (dense_ns - model.rb_word_ns * dense_words) / n);
+
+    std::vector<uint64_t> all_ones_seq(n);
+    std::iota(all_ones_seq.begin(), all_ones_seq.end(), uint64_t(0));
+    model.all_ones_ns = sequence_ns<all_ones_sequence>(all_ones_seq, n, params) / n;
+
+    // partition switches: a partitioned traversal against the traversal
+    // of the same partitions written as standalone sequences, on short
+    // alternating dense and sparse chunks so that the switches dominate
+    std::vector<uint64_t> mixed_seq;
+    uint64_t base = 0;
+    const uint64_t chunk_size = 256;
+    while (mixed_seq.size() < n) {
+        uint64_t gap = (mixed_seq.size() / chunk_size) % 2 ? 1 : 32;
+        auto chunk = random_sequence(gap * chunk_size, chunk_size, rng);
+        for (auto v: chunk) mixed_seq.push_back(base + v);
+        base += gap * chunk_size;
+    }
+    uint64_t universe = base;
+    succinct::bit_vector_builder bvb;
+    partitioned_sequence<>::write(bvb, mixed_seq.begin(), universe, mixed_seq.size(), params);
+    succinct::bit_vector bv(&bvb);
+    partitioned_sequence<>::enumerator e(bv, 0, universe, mixed_seq.size(), params);
+    double partitioned_ns = traversal_ns(e, mixed_seq.size());
+
+    struct standalone_part {
+        uint64_t offset, universe, n;
+    };
+    std::vector<standalone_part> parts;
+    succinct::bit_vector_builder parts_bvb;
+    std::vector<uint64_t> values;
+    for (uint64_t pos = 0; pos < mixed_seq.size(); ) {
+        e.move(pos);
+        auto view = e.partition();
+        values.clear();
+        for (uint64_t i = view.begin; i < view.end; ++i) {
+            values.push_back(mixed_seq[i] - view.base);
+        }
+        standalone_part part = { parts_bvb.size(),
+                                 view.upper_bound - view.base + 1,
+                                 values.size() };
+        indexed_sequence::write(parts_bvb, values.begin(), part.universe, part.n, params);
+        parts.push_back(part);
+        pos = view.end;
+    }
+    succinct::bit_vector parts_bv(&parts_bvb);
+
+    double standalone_ns = std::numeric_limits<double>::max();
+    for (size_t run = 0; run < 5; ++run) {
+        uint64_t checksum = 0;
+        auto tick = get_time_usecs();
+        for (auto const& part: parts) {
+            indexed_sequence::enumerator pe(parts_bv, part.offset, part.universe,
+                                            part.n, params);
+            checksum += pe.move(0).second;
+            for (uint64_t i = 1; i < part.n; ++i) {
+                checksum += pe.next().second;
+            }
+        }
+        do_not_optimize_away(checksum);
+        standalone_ns = std::min(standalone_ns, (get_time_usecs() - tick) * 1000);
+    }
+    model.partition_ns = std::max(0.0, (partitioned_ns - standalone_ns) / parts.size());
+
+    return model;
+}
+
+void lambda_curve(binary_freq_collection const& input,
+                  access_time_model const& model)
+{
+    auto const& conf = configuration::get();
+    global_parameters params;
+    params.access_time = model;
+
+    for (double lambda: {0.0, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0}) {
+        params.space_time_lambda = lambda;
+        uint64_t postings = 0, partitions = 0;
+        double bits = 0, ns = 0;
+        std::vector<uint64_t> seq;
+
+        for (auto const& plist: input) {
+            seq.assign(plist.docs.begin(), plist.docs.end());
+            // the same partition as the docids of create_freq_index
+            optimal_partition opt = partitioned_sequence<>::compute_partition
+                (seq.begin(), input.num_docs(), seq.size(), params,
+                 seq.size() <= conf.exact_partition_max);
+
+            uint64_t begin = 0;
+            for (auto end: opt.partition) {
+                uint64_t base = begin ? seq[begin - 1] + 1 : seq[0];
+                uint64_t part_universe = seq[end - 1] - base + 1;
+                uint64_t part_n = end - begin;
+                uint64_t cost;
+                auto type = indexed_sequence::choose_type(params, part_universe, part_n,
+                                                          params.access_time,
+                                                          params.space_time_lambda, cost);
+                switch (type) {
+                case indexed_sequence::elias_fano:
+                    bits += compact_elias_fano::bitsize(params, part_universe, part_n);
+                    ns += model.elias_fano(part_universe, part_n);
+                    break;
+                case indexed_sequence::ranked_bitvector:
+                    bits += compact_ranked_bitvector::bitsize(params, part_universe, part_n);
+                    ns += model.ranked_bitvector(part_universe, part_n);
+                    break;
+                default:
+                    ns += model.all_ones(part_universe, part_n);
+                }
+                bits += conf.fix_cost;
+                ns += model.partition_ns;
+                begin = end;
+            }
+            postings += seq.size();
+            partitions += opt.partition.size();
+        }
+
+        stats_line()
+            ("lambda", lambda)
+            ("partitions", partitions)
+            ("est_bits_per_doc", bits / postings)
+            ("est_ns_per_doc", ns / postings)
+            ;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    logger() << "Calibrating access times" << std::endl;
+    auto model = calibrate();
+    stats_line()
+        ("ef_ns", model.ef_ns)
+        ("rb_ns", model.rb_ns)
+        ("rb_word_ns", model.rb_word_ns)
+        ("all_ones_ns", model.all_ones_ns)
+        ("partition_ns", model.partition_ns)
+        ;
+    logger() << "Model: "
+             << "QS_TIME_EF=" << model.ef_ns << " "
+             << "QS_TIME_RB=" << model.rb_ns << " "
+             << "QS_TIME_RB_WORD=" << model.rb_word_ns << " "
+             << "QS_TIME_ALL_ONES=" << model.all_ones_ns << " "
+             << "QS_TIME_PARTITION=" << model.partition_ns << std::endl;
+
+    if (argc > 1) {
+        binary_freq_collection input(argv[1]);
+        lambda_curve(input, model);
+    }
+}
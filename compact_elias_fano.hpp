@@ -5,6 +5,7 @@
 #include <succinct/broadword.hpp>
 
 #include "global_parameters.hpp"
+#include "query_counters.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -262,6 +263,7 @@ namespace quasi_succinct {
 
             value_type QS_NOINLINE slow_move(uint64_t position)
             {
+                QS_COUNT(ef_skips);
                 if (QS_UNLIKELY(position == size())) {
                     m_position = position;
                     m_value = m_of.universe;
@@ -290,6 +292,7 @@ namespace quasi_succinct {
 
             value_type QS_NOINLINE slow_next_geq(uint64_t lower_bound)
             {
+                QS_COUNT(ef_skips);
                 if (QS_UNLIKELY(lower_bound >= m_of.universe)) {
                     return move(size());
                 }
@@ -4,6 +4,7 @@
 #include <succinct/bit_vector.hpp>
 #include <succinct/broadword.hpp>
 
+#include "bit_scan.hpp"
 #include "global_parameters.hpp"
 #include "util.hpp"
 
@@ -221,6 +222,13 @@ namespace quasi_succinct {
                 return pos - m_of.bits_offset;
             }
 
+            // offset in the bit vector of the raw bitmap: the bit at
+            // bitmap_offset() + v is set iff v is in the sequence
+            uint64_t bitmap_offset() const
+            {
+                return m_of.bits_offset;
+            }
+
         private:
 
             value_type QS_NOINLINE slow_move(uint64_t position)
@@ -255,15 +263,11 @@ namespace quasi_succinct {
 
             value_type QS_NOINLINE slow_next_geq(uint64_t lower_bound)
             {
-                using succinct::broadword::popcount;
-
                 if (QS_UNLIKELY(lower_bound >= m_of.universe)) {
                     return move(size());
                 }
 
                 uint64_t skip = lower_bound - m_value;
-                m_enumerator = succinct::bit_vector::unary_enumerator
-                    (*m_bv, m_of.bits_offset + lower_bound);
 
                 uint64_t begin;
                 if (lower_bound > m_value
@@ -277,24 +281,15 @@ namespace quasi_succinct {
                 }
 
                 uint64_t end = m_of.bits_offset + lower_bound;
-                uint64_t begin_word = begin / 64;
-                uint64_t begin_shift = begin % 64;
-                uint64_t end_word = end / 64;
-                uint64_t end_shift = end % 64;
-                uint64_t word =
-                    (m_bv->data()[begin_word] >> begin_shift) << begin_shift;
-
-                while (begin_word < end_word) {
-                    m_position += popcount(word);
-                    word = m_bv->data()[++begin_word];
-                }
-                if (end_shift) {
-                    m_position += popcount(word << (64 - end_shift));
-                }
+                uint64_t const* data = m_bv->data().data();
+                m_position += bit_scan::popcount(data, begin, end);
 
                 if (m_position < size()) {
+                    uint64_t pos = bit_scan::next_one(data, end, m_of.end);
+                    m_enumerator = succinct::bit_vector::unary_enumerator(*m_bv, pos);
                     m_value = read_next();
                 } else {
+                    m_enumerator = succinct::bit_vector::unary_enumerator(*m_bv, end);
                     m_value = m_of.universe;
                 }
 
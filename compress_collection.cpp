@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "binary_freq_collection.hpp"
+#include "compressed_freq_collection.hpp"
+#include "util.hpp"
+
+using namespace quasi_succinct;
+
+// Converts a collection to the block-compressed format read by
+// create_freq_index, and optionally checks that it decodes to the input
+
+int main(int argc, const char** argv)
+{
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <collection basename> <output basename> [--check]"
+                  << std::endl;
+        return 1;
+    }
+
+    const char* input_basename = argv[1];
+    std::string output_basename = argv[2];
+    bool check = argc > 3 && std::string(argv[3]) == "--check";
+
+    binary_freq_collection input(input_basename);
+    logger() << "Compressing " << input_basename << std::endl;
+    double tick = get_time_usecs();
+    compressed_freq_collection::write(input, output_basename);
+    double encode_secs = (get_time_usecs() - tick) / 1000000;
+
+    compressed_freq_collection output(output_basename.c_str());
+    uint64_t postings = 0;
+    tick = get_time_usecs();
+    for (auto const& plist: output) {
+        postings += plist.docs.size();
+        do_not_optimize_away(plist.docs.back());
+    }
+    double decode_secs = (get_time_usecs() - tick) / 1000000;
+
+    // docs (with the leading num_docs singleton) and freqs, with the lengths
+    uint64_t input_bytes = 4 * (2 * (postings + output.size()) + 2);
+    logger() << "Compressed " << postings << " postings to "
+             << output.compressed_bytes() << " bytes in "
+             << encode_secs << " seconds" << std::endl;
+
+    stats_line()
+        ("lists", output.size())
+        ("postings", postings)
+        ("input_bytes", input_bytes)
+        ("compressed_bytes", output.compressed_bytes())
+        ("compression_ratio", double(input_bytes) / output.compressed_bytes())
+        ("encode_time", encode_secs)
+        ("decode_time", decode_secs)
+        ("decode_mpostings_per_sec", postings / decode_secs / 1e6)
+        ;
+
+    if (check) {
+        logger() << "Checking the compressed collection..." << std::endl;
+        auto out_it = output.begin();
+        size_t s = 0;
+        for (auto const& plist: input) {
+            if (out_it == output.end() ||
+                plist.docs.size() != out_it->docs.size() ||
+                !std::equal(plist.docs.begin(), plist.docs.end(), out_it->docs.begin()) ||
+                !std::equal(plist.freqs.begin(), plist.freqs.end(), out_it->freqs.begin())) {
+                logger() << "sequence " << s << " differs" << std::endl;
+                return 1;
+            }
+            ++out_it;
+            ++s;
+        }
+        logger() << "Everything is OK!" << std::endl;
+    }
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "block_posting_list.hpp"
+#include "configuration.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Block-compressed variant of binary_freq_collection, stored in the
+    // single file <basename>.compressed. Each list is written as a
+    // block_posting_list, so the docids are gap-encoded and both docids and
+    // freqs are compressed in blocks of 128 with Varint-G8IU, whose decoder
+    // is stateless and thus safe to run in several threads. The layout is
+    //
+    //   num_docs, num_lists, offsets[num_lists + 1]  (64-bit words)
+    //   list data, with list i in [offsets[i], offsets[i + 1])
+    //
+    // Iterating the collection decodes the lists in a pool of
+    // decode_threads threads, ahead of the consumer by at most
+    // decode_ahead_postings postings. The decoded lists are reference counted,
+    // so they stay alive while freq_index::builder reads them
+    // asynchronously; the encoders unwrap the iterators (see
+    // unwrap_iterator) to avoid updating the reference counts at each
+    // posting.
+    class compressed_freq_collection {
+    public:
+        typedef uint32_t posting_type;
+        typedef varint_G8IU_block block_codec;
+        typedef block_posting_list<block_codec> list_codec;
+
+        static std::string filename(std::string const& basename)
+        {
+            return basename + ".compressed";
+        }
+
+        compressed_freq_collection(const char* basename)
+        {
+            m_file.open(filename(basename));
+            if ( !m_file.is_open() ) {
+                throw std::runtime_error("Error opening file");
+            }
+            uint64_t const* header = (uint64_t const*)m_file.data();
+            m_num_docs = header[0];
+            m_num_lists = header[1];
+            m_offsets = header + 2;
+            m_data = (uint8_t const*)(m_offsets + m_num_lists + 1);
+
+            auto ret = posix_madvise((void*)m_file.data(), m_file.size(), POSIX_MADV_SEQUENTIAL);
+            if (ret) logger() << "Error calling madvice: " << errno << std::endl;
+        }
+
+        // Writes the lists of input, a binary_freq_collection or anything
+        // iterable in the same way, to <basename>.compressed
+        template <typename InputCollection>
+        static void write(InputCollection const& input, std::string const& basename)
+        {
+            uint64_t num_lists = 0;
+            for (auto it = input.begin(); it != input.end(); ++it) {
+                num_lists += 1;
+            }
+
+            std::ofstream out(filename(basename).c_str(), std::ios::binary);
+            std::vector<uint64_t> header(2 + num_lists + 1);
+            header[0] = input.num_docs();
+            header[1] = num_lists;
+            out.write((const char*)header.data(), header.size() * sizeof(header[0]));
+
+            std::vector<uint8_t> buf;
+            uint64_t offset = 0;
+            uint64_t list = 0;
+            for (auto const& plist: input) {
+                buf.clear();
+                list_codec::write(buf, plist.docs.size(),
+                                  plist.docs.begin(), plist.freqs.begin());
+                out.write((const char*)buf.data(), buf.size());
+                header[2 + list] = offset;
+                offset += buf.size();
+                list += 1;
+            }
+            header[2 + num_lists] = offset;
+            out.seekp(0);
+            out.write((const char*)header.data(), header.size() * sizeof(header[0]));
+            if (!out) {
+                throw std::runtime_error("Error writing the compressed collection");
+            }
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_num_docs;
+        }
+
+        uint64_t size() const
+        {
+            return m_num_lists;
+        }
+
+        uint64_t compressed_bytes() const
+        {
+            return m_file.size();
+        }
+
+        // The vectors have a trailing zero, as the encoders may read one
+        // element past the end (which in binary_collection is the length of
+        // the next sequence)
+        struct decoded_list {
+            uint64_t size;
+            std::vector<posting_type> docs;
+            std::vector<posting_type> freqs;
+        };
+
+        typedef std::shared_ptr<decoded_list const> decoded_list_ptr;
+
+        decoded_list_ptr decode(uint64_t list) const
+        {
+            auto ret = std::make_shared<decoded_list>();
+            list_codec::document_enumerator e(m_data + m_offsets[list], m_num_docs);
+            ret->size = e.size();
+            ret->docs.resize(e.size() + 1);
+            ret->freqs.resize(e.size() + 1);
+            for (size_t i = 0; i < e.size(); ++i, e.next()) {
+                ret->docs[i] = e.docid();
+                ret->freqs[i] = e.freq();
+            }
+            return ret;
+        }
+
+        typedef shared_buffer_sequence<posting_type> sequence;
+
+        struct freq_sequence {
+            sequence docs;
+            sequence freqs;
+        };
+
+        class iterator;
+
+        iterator begin() const
+        {
+            return iterator(this, 0);
+        }
+
+        iterator end() const
+        {
+            return iterator(this, m_num_lists);
+        }
+
+    private:
+
+        // Decodes the lists in order in a pool of threads; get() must be
+        // called with consecutive list indexes
+        class decode_pipeline {
+        public:
+            decode_pipeline(compressed_freq_collection const& coll, uint64_t first_list)
+                : m_coll(coll)
+                , m_next_list(first_list)
+                , m_consumed(first_list)
+                , m_ahead_postings(0)
+                , m_stop(false)
+            {
+                auto const& conf = configuration::get();
+                m_max_ahead_postings = conf.decode_ahead_postings;
+                size_t threads = std::max(size_t(1), conf.decode_threads);
+                for (size_t i = 0; i < threads; ++i) {
+                    m_threads.emplace_back([this] { decode_loop(); });
+                }
+            }
+
+            ~decode_pipeline()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                }
+                m_cond.notify_all();
+                for (auto& t: m_threads) {
+                    t.join();
+                }
+            }
+
+            decoded_list_ptr get(uint64_t list)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                assert(list == m_consumed);
+                auto it = m_ready.end();
+                m_cond.wait(lock, [&] {
+                        it = m_ready.find(list);
+                        return it != m_ready.end();
+                    });
+                decoded_list_ptr ret = it->second;
+                m_ready.erase(it);
+                m_consumed = list + 1;
+                m_ahead_postings -= ret->size;
+                lock.unlock();
+                m_cond.notify_all();
+                return ret;
+            }
+
+        private:
+
+            void decode_loop()
+            {
+                std::vector<decoded_list_ptr> decoded;
+                while (true) {
+                    uint64_t first_list, last_list;
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        // the next list to be consumed is always decoded
+                        m_cond.wait(lock, [&] {
+                                return m_stop || m_next_list == m_coll.size() ||
+                                    m_next_list == m_consumed ||
+                                    m_ahead_postings < m_max_ahead_postings;
+                            });
+                        if (m_stop || m_next_list == m_coll.size()) return;
+                        // short lists are taken in batches to amortize the
+                        // synchronization
+                        first_list = m_next_list;
+                        uint64_t batch_postings = 0;
+                        do {
+                            batch_postings += m_coll.list_size(m_next_list++);
+                        } while (m_next_list < m_coll.size() &&
+                                 batch_postings < batch_max_postings);
+                        last_list = m_next_list;
+                        m_ahead_postings += batch_postings;
+                    }
+
+                    decoded.clear();
+                    for (uint64_t list = first_list; list < last_list; ++list) {
+                        decoded.push_back(m_coll.decode(list));
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        for (uint64_t list = first_list; list < last_list; ++list) {
+                            m_ready[list] = decoded[list - first_list];
+                        }
+                    }
+                    m_cond.notify_all();
+                }
+            }
+
+            static const uint64_t batch_max_postings = 1 << 12;
+
+            compressed_freq_collection const& m_coll;
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::map<uint64_t, decoded_list_ptr> m_ready;
+            uint64_t m_next_list;
+            uint64_t m_consumed;
+            uint64_t m_ahead_postings;
+            uint64_t m_max_ahead_postings;
+            bool m_stop;
+            std::vector<std::thread> m_threads;
+        };
+
+        uint64_t list_size(uint64_t list) const
+        {
+            uint32_t n;
+            TightVariableByte::decode(m_data + m_offsets[list], &n, 1);
+            return n;
+        }
+
+    public:
+
+        // Single-pass iterator: copies share the decode pipeline
+        class iterator : public std::iterator<std::forward_iterator_tag,
+                                              freq_sequence> {
+        public:
+            iterator()
+                : m_collection(nullptr)
+            {}
+
+            value_type const& operator*() const
+            {
+                return m_cur_seq;
+            }
+
+            value_type const* operator->() const
+            {
+                return &m_cur_seq;
+            }
+
+            iterator& operator++()
+            {
+                m_pos += 1;
+                read();
+                return *this;
+            }
+
+            bool operator==(iterator const& other) const
+            {
+                assert(m_collection == other.m_collection);
+                return m_pos == other.m_pos;
+            }
+
+            bool operator!=(iterator const& other) const
+            {
+                return !(*this == other);
+            }
+
+        private:
+            friend class compressed_freq_collection;
+
+            iterator(compressed_freq_collection const* coll, uint64_t pos)
+                : m_collection(coll)
+                , m_pos(pos)
+            {
+                if (m_pos < m_collection->size()) {
+                    m_pipeline = std::make_shared<decode_pipeline>(*m_collection, m_pos);
+                }
+                read();
+            }
+
+            void read()
+            {
+                assert(m_pos <= m_collection->size());
+                if (m_pos == m_collection->size()) {
+                    m_pipeline.reset();
+                    m_cur_seq = freq_sequence();
+                    return;
+                }
+
+                decoded_list_ptr list = m_pipeline->get(m_pos);
+                m_cur_seq.docs = sequence(list, list->docs.data(),
+                                          list->docs.data() + list->size);
+                m_cur_seq.freqs = sequence(list, list->freqs.data(),
+                                           list->freqs.data() + list->size);
+            }
+
+            compressed_freq_collection const* m_collection;
+            uint64_t m_pos;
+            std::shared_ptr<decode_pipeline> m_pipeline;
+            freq_sequence m_cur_seq;
+        };
+
+    private:
+        boost::iostreams::mapped_file_source m_file;
+        uint64_t m_num_docs;
+        uint64_t m_num_lists;
+        uint64_t const* m_offsets;
+        uint8_t const* m_data;
+    };
+}
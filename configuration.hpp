@@ -5,6 +5,9 @@
 #include <thread>
 #include <boost/lexical_cast.hpp>
 
+#include "access_time_model.hpp"
+#include "global_parameters.hpp"
+
 namespace quasi_succinct {
 
     class configuration {
@@ -17,9 +20,39 @@ namespace quasi_succinct {
         double eps1;
         double eps2;
         uint64_t fix_cost;
+        // weight of the estimated access time in the partitioning cost, in
+        // bits per nanosecond; 0 minimizes space only
+        double space_time_lambda;
+        access_time_model access_time;
+        // lists up to this length are partitioned exactly rather than with
+        // the eps1/eps2 approximation, using partition_threads threads
+        uint64_t exact_partition_max;
+        size_t partition_threads;
 
         size_t log_partition_size;
+        size_t ef_log_sampling0;
+        size_t ef_log_sampling1;
+        size_t rb_log_rank1_sampling;
+        size_t rb_log_sampling1;
+        bool flat_endpoints;
+        bool list_headers;
         size_t worker_threads;
+        // threads decoding a compressed_freq_collection, and how many
+        // postings they may decode ahead of the consumer
+        size_t decode_threads;
+        uint64_t decode_ahead_postings;
+        // read binary collections with prefetched_freq_collection, in chunks
+        // of prefetch_chunk bytes at most prefetch_ahead chunks ahead,
+        // optionally bypassing the page cache
+        bool prefetch;
+        uint64_t prefetch_chunk;
+        uint64_t prefetch_ahead;
+        bool direct_io;
+        // bits of the quantized norm lens in wand_data, 0 for floats
+        size_t norm_len_bits;
+        // memory budget of decoded_list_cache; 0 (the default) disables
+        // the decoded operators of queries
+        uint64_t decoded_cache_mb;
 
     private:
         configuration()
@@ -27,8 +60,32 @@ namespace quasi_succinct {
             fillvar("QS_EPS1", eps1, 0.03);
             fillvar("QS_EPS2", eps2, 0.3);
             fillvar("QS_FIXCOST", fix_cost, 64);
+            fillvar("QS_LAMBDA", space_time_lambda, 0.0);
+            access_time_model default_time;
+            fillvar("QS_TIME_EF", access_time.ef_ns, default_time.ef_ns);
+            fillvar("QS_TIME_RB", access_time.rb_ns, default_time.rb_ns);
+            fillvar("QS_TIME_RB_WORD", access_time.rb_word_ns, default_time.rb_word_ns);
+            fillvar("QS_TIME_ALL_ONES", access_time.all_ones_ns, default_time.all_ones_ns);
+            fillvar("QS_TIME_PARTITION", access_time.partition_ns, default_time.partition_ns);
+            fillvar("QS_EXACT_PARTITION", exact_partition_max, 0);
+            fillvar("QS_PARTITION_THREADS", partition_threads, 1);
             fillvar("QS_LOG_PART", log_partition_size, 7);
+            global_parameters defaults;
+            fillvar("QS_EF_LOG_SAMPLING0", ef_log_sampling0, defaults.ef_log_sampling0);
+            fillvar("QS_EF_LOG_SAMPLING1", ef_log_sampling1, defaults.ef_log_sampling1);
+            fillvar("QS_RB_LOG_RANK1_SAMPLING", rb_log_rank1_sampling, defaults.rb_log_rank1_sampling);
+            fillvar("QS_RB_LOG_SAMPLING1", rb_log_sampling1, defaults.rb_log_sampling1);
+            fillvar("QS_FLAT_ENDPOINTS", flat_endpoints, false);
+            fillvar("QS_LIST_HEADERS", list_headers, false);
             fillvar("QS_THREADS", worker_threads, std::thread::hardware_concurrency());
+            fillvar("QS_DECODE_THREADS", decode_threads, 2);
+            fillvar("QS_DECODE_AHEAD", decode_ahead_postings, 1 << 24);
+            fillvar("QS_PREFETCH", prefetch, false);
+            fillvar("QS_PREFETCH_CHUNK", prefetch_chunk, 1 << 26);
+            fillvar("QS_PREFETCH_AHEAD", prefetch_ahead, 2);
+            fillvar("QS_DIRECT_IO", direct_io, false);
+            fillvar("QS_NORM_LEN_BITS", norm_len_bits, 0);
+            fillvar("QS_DECODED_CACHE_MB", decoded_cache_mb, 0);
         }
 
         template <typename T, typename T2>
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <random>
+
+#include <boost/lexical_cast.hpp>
+
+#include "succinct/mapper.hpp"
+#include "binary_freq_collection.hpp"
+#include "deleted_docs.hpp"
+#include "util.hpp"
+
+int main(int argc, const char** argv) {
+
+    using namespace quasi_succinct;
+
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <collection basename> <output filename> [<random fraction>]"
+                  << std::endl
+                  << "Reads the deleted docids from standard input, one per line,"
+                  << " unless a fraction of the documents to delete at random is given"
+                  << std::endl;
+        return 1;
+    }
+
+    binary_freq_collection coll(argv[1]);
+    const char* output_filename = argv[2];
+    uint64_t num_docs = coll.num_docs();
+
+    std::vector<uint64_t> docids;
+    if (argc > 3) {
+        double fraction = boost::lexical_cast<double>(argv[3]);
+        std::mt19937_64 rng(1729);
+        std::bernoulli_distribution coin(fraction);
+        for (uint64_t docid = 0; docid < num_docs; ++docid) {
+            if (coin(rng)) docids.push_back(docid);
+        }
+    } else {
+        uint64_t docid;
+        while (std::cin >> docid) docids.push_back(docid);
+    }
+
+    deleted_docs deleted(num_docs, docids.begin(), docids.end());
+    logger() << deleted.num_deleted() << " of " << num_docs
+             << " documents deleted" << std::endl;
+    succinct::mapper::freeze(deleted, output_filename);
+}
@@ -7,7 +7,9 @@
 #include <succinct/mapper.hpp>
 
 #include "configuration.hpp"
+#include "compressed_freq_collection.hpp"
 #include "index_types.hpp"
+#include "prefetched_freq_collection.hpp"
 #include "util.hpp"
 
 using quasi_succinct::logger;
@@ -153,6 +155,7 @@ void dump_index_specific_stats(quasi_succinct::opt_index const& coll,
         ("eps1", conf.eps1)
         ("eps2", conf.eps2)
         ("fix_cost", conf.fix_cost)
+        ("lambda", coll.params().space_time_lambda)
         ("docs_avg_part", long_postings / docs_partitions)
         ("freqs_avg_part", long_postings / freqs_partitions)
         ;
@@ -194,6 +197,7 @@ void create_collection(InputCollection const& input,
     logger() << "Processing " << input.num_docs() << " documents" << std::endl;
     double tick = get_time_usecs();
     double user_tick = get_user_time_usecs();
+    auto faults_tick = get_page_faults();
 
     typename CollectionType::builder builder(input.num_docs(), params);
     progress_logger plog;
@@ -211,14 +215,23 @@ void create_collection(InputCollection const& input,
     builder.build(coll);
     double elapsed_secs = (get_time_usecs() - tick) / 1000000;
     double user_elapsed_secs = (get_user_time_usecs() - user_tick) / 1000000;
+    auto faults = get_page_faults();
     logger() << seq_type << " collection built in "
              << elapsed_secs << " seconds" << std::endl;
 
     stats_line()
         ("type", seq_type)
         ("worker_threads", configuration::get().worker_threads)
+        ("flat_endpoints", int(params.flat_endpoints))
+        ("list_headers", int(params.list_headers))
+        ("ef_log_sampling0", int(params.ef_log_sampling0))
+        ("ef_log_sampling1", int(params.ef_log_sampling1))
+        ("rb_log_rank1_sampling", int(params.rb_log_rank1_sampling))
+        ("rb_log_sampling1", int(params.rb_log_sampling1))
         ("construction_time", elapsed_secs)
         ("construction_user_time", user_elapsed_secs)
+        ("construction_minor_faults", faults.first - faults_tick.first)
+        ("construction_major_faults", faults.second - faults_tick.second)
         ;
 
     dump_stats(coll, seq_type, plog.postings);
@@ -233,6 +246,29 @@ void create_collection(InputCollection const& input,
 }
 
 
+template <typename InputCollection>
+void create_collection(std::string const& type, InputCollection const& input,
+                       quasi_succinct::global_parameters const& params,
+                       const char* output_filename, bool check)
+{
+    using namespace quasi_succinct;
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                   \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {             \
+            create_collection<InputCollection,                  \
+                              BOOST_PP_CAT(T, _index)>          \
+                (input, params, output_filename, check, type);  \
+            /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << type << std::endl;
+    }
+}
+
+
 int main(int argc, const char** argv) {
 
     using namespace quasi_succinct;
@@ -240,6 +276,7 @@ int main(int argc, const char** argv) {
     if (argc < 3) {
         std::cerr << "Usage: " << argv[0]
                   << " <index type> <collection basename> [<output filename>]"
+                  << " [--check] [--compressed]"
                   << std::endl;
         return 1;
     }
@@ -252,26 +289,47 @@ int main(int argc, const char** argv) {
     }
 
     bool check = false;
-    if (argc > 4 && std::string(argv[4]) == "--check") {
-        check = true;
+    bool compressed = false;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--check") {
+            check = true;
+        } else if (arg == "--compressed") {
+            compressed = true;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
     }
 
-    binary_freq_collection input(input_basename);
     quasi_succinct::global_parameters params;
     params.log_partition_size = configuration::get().log_partition_size;
-
-    if (false) {
-#define LOOP_BODY(R, DATA, T)                                   \
-        } else if (type == BOOST_PP_STRINGIZE(T)) {             \
-            create_collection<binary_freq_collection,           \
-                              BOOST_PP_CAT(T, _index)>          \
-                (input, params, output_filename, check, type);  \
-            /**/
-
-        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
-#undef LOOP_BODY
+    params.ef_log_sampling0 = configuration::get().ef_log_sampling0;
+    params.ef_log_sampling1 = configuration::get().ef_log_sampling1;
+    params.rb_log_rank1_sampling = configuration::get().rb_log_rank1_sampling;
+    params.rb_log_sampling1 = configuration::get().rb_log_sampling1;
+    params.flat_endpoints = configuration::get().flat_endpoints;
+    params.list_headers = configuration::get().list_headers;
+    params.space_time_lambda = configuration::get().space_time_lambda;
+    params.access_time = configuration::get().access_time;
+
+    if (compressed) {
+        compressed_freq_collection input(input_basename);
+        logger() << "Reading the compressed collection "
+                 << compressed_freq_collection::filename(input_basename)
+                 << " with " << configuration::get().decode_threads
+                 << " decode threads" << std::endl;
+        create_collection(type, input, params, output_filename, check);
+    } else if (configuration::get().prefetch) {
+        prefetched_freq_collection input(input_basename);
+        logger() << "Reading the collection " << input_basename
+                 << " with prefetching, "
+                 << (configuration::get().prefetch_chunk >> 20) << "MB chunks" << std::endl;
+        create_collection(type, input, params, output_filename, check);
     } else {
-        logger() << "ERROR: Unknown type " << type << std::endl;
+        binary_freq_collection input(input_basename);
+        logger() << "Reading the collection " << input_basename << std::endl;
+        create_collection(type, input, params, output_filename, check);
     }
 
     return 0;
@@ -4,16 +4,84 @@
 #include "succinct/mapper.hpp"
 #include "binary_freq_collection.hpp"
 #include "binary_collection.hpp"
+#include "configuration.hpp"
+#include "index_types.hpp"
 #include "wand_data.hpp"
 #include "util.hpp"
 
+using quasi_succinct::logger;
+
+template <typename InputType>
+void create_wand_data(quasi_succinct::binary_collection const& sizes_coll,
+                      uint64_t num_docs, InputType const& input,
+                      const char* output_filename, std::string const& input_type)
+{
+    using namespace quasi_succinct;
+
+    if (sizes_coll.begin()->size() != num_docs) {
+        throw std::invalid_argument("The sizes do not match the number of documents");
+    }
+
+    double tick = get_time_usecs();
+    double user_tick = get_user_time_usecs();
+    wand_data<> wdata(sizes_coll.begin()->begin(), num_docs, input);
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    double user_elapsed_secs = (get_user_time_usecs() - user_tick) / 1000000;
+    logger() << "wand_data built in " << elapsed_secs << " seconds" << std::endl;
+
+    stats_line()
+        ("input", input_type)
+        ("worker_threads", configuration::get().worker_threads)
+        ("construction_time", elapsed_secs)
+        ("construction_user_time", user_elapsed_secs)
+        ;
+
+    succinct::mapper::freeze(wdata, output_filename);
+}
+
+template <typename IndexType>
+void create_wand_data_from_index(const char* index_filename,
+                                 quasi_succinct::binary_collection const& sizes_coll,
+                                 const char* output_filename, std::string const& type)
+{
+    IndexType index;
+    boost::iostreams::mapped_file_source m(index_filename);
+    succinct::mapper::map(index, m);
+    create_wand_data(sizes_coll, index.num_docs(), index, output_filename, type);
+}
+
 int main(int argc, const char** argv) {
 
     using namespace quasi_succinct;
 
+    if (argc == 6 && std::string(argv[1]) == "--index") {
+        // the collection files are not needed, only the document sizes
+        std::string type = argv[2];
+        const char* index_filename = argv[3];
+        binary_collection sizes_coll(argv[4]);
+        const char* output_filename = argv[5];
+
+        if (false) {
+#define LOOP_BODY(R, DATA, T)                                           \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {                     \
+            create_wand_data_from_index<BOOST_PP_CAT(T, _index)>        \
+                (index_filename, sizes_coll, output_filename, type);    \
+            /**/
+
+            BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
+#undef LOOP_BODY
+        } else {
+            logger() << "ERROR: Unknown type " << type << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     if (argc != 3) {
         std::cerr << "Usage: " << argv[0]
-                  << " <collection basename> <output filename>"
+                  << " <collection basename> <output filename>" << std::endl
+                  << "       " << argv[0]
+                  << " --index <index type> <index filename> <sizes filename> <output filename>"
                   << std::endl;
         return 1;
     }
@@ -23,7 +91,5 @@ int main(int argc, const char** argv) {
 
     binary_collection sizes_coll((input_basename + ".sizes").c_str());
     binary_freq_collection coll(input_basename.c_str());
-
-    wand_data<> wdata(sizes_coll.begin()->begin(), coll.num_docs(), coll);
-    succinct::mapper::freeze(wdata, output_filename);
+    create_wand_data(sizes_coll, coll.num_docs(), coll, output_filename, "collection");
 }
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "configuration.hpp"
+#include "queries.hpp"
+
+namespace quasi_succinct {
+
+    // Cache of fully decoded posting lists for the hot terms of an index,
+    // so that they are not decompressed again at each query. Like
+    // enumerator_cache it exposes the interface of an index
+    // (document_enumerator, operator[], num_docs, size) so that the query
+    // operators can be run on it unchanged; operator[] returns an
+    // enumerator over the decoded arrays for the cached terms, or wraps the
+    // index enumerator for the others.
+    //
+    // The terms are admitted by decreasing frequency in a query log times
+    // list length, that is by the number of postings they would have
+    // decoded, within a memory budget (QS_DECODED_CACHE_MB) of 8 bytes
+    // per posting (docid and freq). The cached lists are an immutable
+    // snapshot that can be replaced with prepare() while other threads are
+    // querying: the enumerators keep their list alive, and operator[] is
+    // thread-safe. prepare() itself must be called by one thread at a time.
+    template <typename Index>
+    class decoded_list_cache {
+    public:
+        typedef typename Index::document_enumerator index_enumerator;
+
+        decoded_list_cache(Index const& index,
+                           uint64_t budget_bytes = configuration::get().decoded_cache_mb << 20)
+            : m_index(index)
+            , m_budget_bytes(budget_bytes)
+            , m_snapshot(std::make_shared<snapshot>())
+            , m_hits(0)
+            , m_misses(0)
+        {}
+
+    private:
+
+        // docs has a trailing sentinel equal to num_docs, so that docid()
+        // past the end behaves as in the index enumerators
+        struct decoded_list {
+            std::vector<uint32_t> docs;
+            std::vector<uint32_t> freqs;
+        };
+
+        typedef std::shared_ptr<decoded_list const> decoded_list_ptr;
+
+        struct snapshot {
+            std::unordered_map<term_id_type, decoded_list_ptr> lists;
+            uint64_t bytes = 0;
+        };
+
+        typedef std::shared_ptr<snapshot const> snapshot_ptr;
+
+    public:
+
+        class document_enumerator {
+        public:
+            void next()
+            {
+                if (m_docs) {
+                    QS_COUNT(next);
+                    m_pos += 1;
+                } else {
+                    m_enum->next();
+                }
+            }
+
+            void next_geq(uint64_t lower_bound)
+            {
+                if (!m_docs) {
+                    m_enum->next_geq(lower_bound);
+                    return;
+                }
+                QS_COUNT(next_geq);
+                if (m_docs[m_pos] >= lower_bound) return;
+                // galloping search, as the skips are usually short
+                uint64_t lo = m_pos;
+                uint64_t step = 1;
+                uint64_t hi = m_pos + step;
+                while (hi < m_size && m_docs[hi] < lower_bound) {
+                    lo = hi;
+                    step *= 2;
+                    hi = m_pos + step;
+                }
+                hi = std::min(hi, m_size);
+                m_pos = uint64_t(std::lower_bound(m_docs + lo + 1, m_docs + hi,
+                                                  lower_bound) - m_docs);
+            }
+
+            void move(uint64_t position)
+            {
+                if (m_docs) {
+                    m_pos = position;
+                } else {
+                    m_enum->move(position);
+                }
+            }
+
+            uint64_t docid() const
+            {
+                return m_docs ? m_docs[m_pos] : m_enum->docid();
+            }
+
+            uint64_t freq()
+            {
+                return m_docs ? m_freqs[m_pos] : m_enum->freq();
+            }
+
+            uint64_t position() const
+            {
+                return m_docs ? m_pos : m_enum->position();
+            }
+
+            uint64_t size() const
+            {
+                return m_docs ? m_size : m_enum->size();
+            }
+
+        private:
+            friend class decoded_list_cache;
+
+            document_enumerator(decoded_list_ptr const& list)
+                : m_list(list)
+                , m_docs(list->docs.data())
+                , m_freqs(list->freqs.data())
+                , m_size(list->freqs.size())
+                , m_pos(0)
+            {}
+
+            document_enumerator(index_enumerator const& e)
+                : m_enum(e)
+                , m_docs(nullptr)
+                , m_freqs(nullptr)
+                , m_size(0)
+                , m_pos(0)
+            {}
+
+            // exactly one of m_list and m_enum is set
+            decoded_list_ptr m_list;
+            boost::optional<index_enumerator> m_enum;
+            uint32_t const* m_docs;
+            uint32_t const* m_freqs;
+            uint64_t m_size;
+            uint64_t m_pos;
+        };
+
+        // Replaces the cached lists with the hot terms of the given query
+        // log; lists that stay cached are not decoded again
+        void prepare(std::vector<term_id_vec> const& queries)
+        {
+            std::unordered_map<term_id_type, uint64_t> term_counts;
+            term_id_vec terms;
+            for (auto const& query: queries) {
+                terms = query;
+                remove_duplicate_terms(terms);
+                for (auto term: terms) {
+                    if (term < m_index.size()) {
+                        term_counts[term] += 1;
+                    }
+                }
+            }
+
+            struct candidate {
+                term_id_type term;
+                uint64_t size;
+                uint64_t score;
+            };
+            std::vector<candidate> candidates;
+            for (auto const& tc: term_counts) {
+                uint64_t size = m_index[tc.first].size();
+                candidates.push_back(candidate {tc.first, size, tc.second * size});
+            }
+            std::sort(candidates.begin(), candidates.end(),
+                      [](candidate const& lhs, candidate const& rhs) {
+                          return lhs.score > rhs.score ||
+                              (lhs.score == rhs.score && lhs.term < rhs.term);
+                      });
+
+            snapshot_ptr old_snapshot = current();
+            auto new_snapshot = std::make_shared<snapshot>();
+            for (auto const& c: candidates) {
+                uint64_t bytes = list_bytes(c.size);
+                if (new_snapshot->bytes + bytes > m_budget_bytes) continue;
+                new_snapshot->bytes += bytes;
+                auto it = old_snapshot->lists.find(c.term);
+                if (it != old_snapshot->lists.end()) {
+                    new_snapshot->lists.emplace(c.term, it->second);
+                } else {
+                    new_snapshot->lists.emplace(c.term, std::make_shared<decoded_list>(decode(c.term)));
+                }
+            }
+
+            std::atomic_store(&m_snapshot, snapshot_ptr(new_snapshot));
+        }
+
+        document_enumerator operator[](size_t term) const
+        {
+            snapshot_ptr snap = current();
+            auto it = snap->lists.find(term_id_type(term));
+            if (it != snap->lists.end()) {
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return document_enumerator(it->second);
+            }
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return document_enumerator(m_index[term]);
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_index.num_docs();
+        }
+
+        size_t size() const
+        {
+            return m_index.size();
+        }
+
+        size_t cached_terms() const
+        {
+            return current()->lists.size();
+        }
+
+        uint64_t cached_bytes() const
+        {
+            return current()->bytes;
+        }
+
+        uint64_t hits() const
+        {
+            return m_hits;
+        }
+
+        uint64_t misses() const
+        {
+            return m_misses;
+        }
+
+    private:
+
+        static uint64_t list_bytes(uint64_t size)
+        {
+            return (2 * size + 1) * sizeof(uint32_t);
+        }
+
+        snapshot_ptr current() const
+        {
+            return std::atomic_load(&m_snapshot);
+        }
+
+        decoded_list decode(term_id_type term) const
+        {
+            decoded_list list;
+            auto e = m_index[term];
+            list.docs.resize(e.size() + 1);
+            list.freqs.resize(e.size());
+            for (size_t i = 0; i < e.size(); ++i, e.next()) {
+                list.docs[i] = uint32_t(e.docid());
+                list.freqs[i] = uint32_t(e.freq());
+            }
+            list.docs[e.size()] = uint32_t(m_index.num_docs());
+            return list;
+        }
+
+        Index const& m_index;
+        uint64_t m_budget_bytes;
+        snapshot_ptr m_snapshot;
+        mutable std::atomic<uint64_t> m_hits;
+        mutable std::atomic<uint64_t> m_misses;
+    };
+}
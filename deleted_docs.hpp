@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <succinct/bit_vector.hpp>
+
+namespace quasi_succinct {
+
+    // Set of deleted docids, checked by the query operators to retract
+    // documents without rebuilding the index. It is stored as a bitmap over
+    // the docids, so that a lookup is a single bit access: at the densities
+    // of interest (up to a few percent) it is not much larger than an
+    // Elias-Fano encoding and does not need a rank.
+    class deleted_docs {
+    public:
+        deleted_docs()
+            : m_num_deleted(0)
+        {}
+
+        template <typename Iterator>
+        deleted_docs(uint64_t num_docs, Iterator begin, Iterator end)
+        {
+            std::vector<uint64_t> docids(begin, end);
+            std::sort(docids.begin(), docids.end());
+            docids.erase(std::unique(docids.begin(), docids.end()), docids.end());
+            if (!docids.empty() && docids.back() >= num_docs) {
+                throw std::invalid_argument("Deleted docid out of range");
+            }
+
+            succinct::bit_vector_builder bvb(num_docs);
+            for (auto docid: docids) {
+                bvb.set(docid, 1);
+            }
+            m_num_deleted = docids.size();
+            succinct::bit_vector(&bvb).swap(m_bits);
+        }
+
+        bool contains(uint64_t docid) const
+        {
+            return docid < m_bits.size() && m_bits[docid];
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_bits.size();
+        }
+
+        uint64_t num_deleted() const
+        {
+            return m_num_deleted;
+        }
+
+        void swap(deleted_docs& other)
+        {
+            std::swap(m_num_deleted, other.m_num_deleted);
+            m_bits.swap(other.m_bits);
+        }
+
+        template <typename Visitor>
+        void map(Visitor& visit)
+        {
+            visit
+                (m_num_deleted, "m_num_deleted")
+                (m_bits, "m_bits")
+                ;
+        }
+
+    private:
+        uint64_t m_num_deleted;
+        succinct::bit_vector m_bits;
+    };
+
+    // Used by the query operators: a null filter deletes nothing
+    inline bool is_deleted(deleted_docs const* deleted, uint64_t docid)
+    {
+        return deleted && deleted->contains(docid);
+    }
+
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include "queries.hpp"
+
+namespace quasi_succinct {
+
+    // Cache of freshly constructed document enumerators for the hot terms of
+    // a batch of queries. It exposes the same interface as an index
+    // (document_enumerator, operator[], num_docs, size) so that the query
+    // operators can be run on it unchanged: operator[] returns a copy of the
+    // cached prototype, skipping the endpoint lookup and header parsing, or
+    // falls back to the index for terms that are not cached.
+    //
+    // The cache is not thread-safe; each query thread should own one.
+    template <typename Index>
+    class enumerator_cache {
+    public:
+        typedef typename Index::document_enumerator document_enumerator;
+
+        enumerator_cache(Index const& index, size_t capacity = 1024)
+            : m_index(index)
+            , m_capacity(capacity)
+            , m_hits(0)
+            , m_misses(0)
+        {}
+
+        // Selects the terms to cache for the given batch: the ones that
+        // appear in at least two queries, most frequent first, up to the
+        // cache capacity. Prototypes of terms that stay hot are reused.
+        void prepare(std::vector<term_id_vec> const& queries)
+        {
+            std::unordered_map<term_id_type, uint64_t> term_counts;
+            term_id_vec terms;
+            for (auto const& query: queries) {
+                terms = query;
+                remove_duplicate_terms(terms);
+                for (auto term: terms) {
+                    term_counts[term] += 1;
+                }
+            }
+
+            std::vector<std::pair<uint64_t, term_id_type>> hot_terms;
+            for (auto const& tc: term_counts) {
+                if (tc.second > 1 && tc.first < m_index.size()) {
+                    hot_terms.emplace_back(tc.second, tc.first);
+                }
+            }
+            std::sort(hot_terms.begin(), hot_terms.end(),
+                      [](std::pair<uint64_t, term_id_type> const& lhs,
+                         std::pair<uint64_t, term_id_type> const& rhs) {
+                          return lhs.first > rhs.first ||
+                              (lhs.first == rhs.first && lhs.second < rhs.second);
+                      });
+            if (hot_terms.size() > m_capacity) {
+                hot_terms.resize(m_capacity);
+            }
+
+            prototypes_type prototypes;
+            prototypes.reserve(hot_terms.size());
+            for (auto const& ht: hot_terms) {
+                auto it = m_prototypes.find(ht.second);
+                if (it != m_prototypes.end()) {
+                    prototypes.emplace(ht.second, std::move(it->second));
+                } else {
+                    prototypes.emplace(ht.second, m_index[ht.second]);
+                }
+            }
+            m_prototypes.swap(prototypes);
+        }
+
+        document_enumerator operator[](size_t term) const
+        {
+            auto it = m_prototypes.find(term_id_type(term));
+            if (it != m_prototypes.end()) {
+                m_hits += 1;
+                return it->second;
+            }
+            m_misses += 1;
+            return m_index[term];
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_index.num_docs();
+        }
+
+        size_t size() const
+        {
+            return m_index.size();
+        }
+
+        size_t cached_terms() const
+        {
+            return m_prototypes.size();
+        }
+
+        uint64_t hits() const
+        {
+            return m_hits;
+        }
+
+        uint64_t misses() const
+        {
+            return m_misses;
+        }
+
+        void clear()
+        {
+            m_prototypes.clear();
+            m_hits = m_misses = 0;
+        }
+
+    private:
+        typedef std::unordered_map<term_id_type, document_enumerator> prototypes_type;
+
+        Index const& m_index;
+        size_t m_capacity;
+        prototypes_type m_prototypes;
+        mutable uint64_t m_hits;
+        mutable uint64_t m_misses;
+    };
+
+    // Evaluates a batch of queries back to back, sharing the enumerator
+    // setup of the terms that occur in more than one query. handler(i, r)
+    // is called after the i-th query with its result r, so that ranked
+    // operators can be inspected through their topk().
+    template <typename Index, typename QueryOperator, typename ResultHandler>
+    void batch_query(enumerator_cache<Index>& cache,
+                     QueryOperator&& query_op,
+                     std::vector<term_id_vec> const& queries,
+                     ResultHandler&& handler)
+    {
+        cache.prepare(queries);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            handler(i, query_op(cache, queries[i]));
+        }
+    }
+}
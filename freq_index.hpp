@@ -1,20 +1,43 @@
 #pragma once
 
+#include <cstring>
+#include <limits>
+
+#include <succinct/mappable_vector.hpp>
+
 #include "bitvector_collection.hpp"
 #include "compact_elias_fano.hpp"
 #include "integer_codes.hpp"
 #include "global_parameters.hpp"
+#include "query_counters.hpp"
+#include "sequence_header.hpp"
 #include "semiasync_queue.hpp"
 
 namespace quasi_succinct {
 
     template <typename DocsSequence, typename FreqsSequence>
     class freq_index {
+        typedef sequence_header<DocsSequence> docs_header_traits;
+        typedef sequence_header<FreqsSequence> freqs_header_traits;
+
     public:
         freq_index()
             : m_num_docs(0)
         {}
 
+        // everything needed to construct the enumerators of a list without
+        // parsing it; stored for each list if params.list_headers. The
+        // counts are 32 bits to keep the table small, a list whose counts
+        // do not fit has n = 0 and is parsed instead.
+        struct list_header {
+            uint64_t docs_offset;
+            uint64_t freqs_offset;
+            uint32_t occurrences;
+            uint32_t n;
+            typename docs_header_traits::type docs_header;
+            typename freqs_header_traits::type freqs_header;
+        };
+
         class builder {
         public:
             builder(uint64_t num_docs, global_parameters const& params)
@@ -39,6 +62,17 @@ namespace quasi_succinct {
                 m_queue.add_job(ptr, 2 * n);
             }
 
+            // Appends the list of the given term of a, followed by the list
+            // of b with the docids shifted by a.num_docs(); the term is
+            // absent from an index if it is not less than its size. The
+            // sequences are merged in encoded form with write_merged, so
+            // a, b and the builder must have the same parameters.
+            void add_merged_list(freq_index const& a, freq_index const& b, size_t term)
+            {
+                std::shared_ptr<list_merger> ptr(new list_merger(*this, a, b, term));
+                m_queue.add_job(ptr, 2 * ptr->n);
+            }
+
             void build(freq_index& sq)
             {
                 m_queue.complete();
@@ -47,6 +81,15 @@ namespace quasi_succinct {
 
                 m_docs_sequences.build(sq.m_docs_sequences);
                 m_freqs_sequences.build(sq.m_freqs_sequences);
+
+                if (m_params.list_headers) {
+                    // read in place, so that no copy loses the zeroed padding
+                    std::vector<list_header> headers(sq.size());
+                    for (size_t i = 0; i < sq.size(); ++i) {
+                        sq.read_list_header(i, headers[i]);
+                    }
+                    sq.m_list_headers.steal(headers);
+                }
             }
 
         private:
@@ -72,11 +115,11 @@ namespace quasi_succinct {
                         docs_bits.append_bits(n, ceil_log2(occurrences + 1));
                     }
 
-                    DocsSequence::write(docs_bits, docs_begin,
+                    DocsSequence::write(docs_bits, unwrap_iterator(docs_begin),
                                         b.m_num_docs, n,
                                         b.m_params);
 
-                    FreqsSequence::write(freqs_bits, freqs_begin,
+                    FreqsSequence::write(freqs_bits, unwrap_iterator(freqs_begin),
                                          occurrences + 1, n,
                                          b.m_params);
                 }
@@ -96,6 +139,79 @@ namespace quasi_succinct {
                 succinct::bit_vector_builder freqs_bits;
             };
 
+            struct list_merger : semiasync_queue::job {
+                list_merger(builder& b, freq_index const& a_index,
+                            freq_index const& b_index, size_t term)
+                    : b(b)
+                    , a_index(a_index)
+                    , b_index(b_index)
+                    , a_occurrences(0)
+                    , occurrences(0)
+                {
+                    if (term < a_index.size()) {
+                        read_list(a_index, term, a_docs, a_freqs, a_occurrences);
+                    }
+                    uint64_t b_occurrences = 0;
+                    if (term < b_index.size()) {
+                        read_list(b_index, term, b_docs, b_freqs, b_occurrences);
+                    }
+                    occurrences = a_occurrences + b_occurrences;
+                    n = a_docs.n + b_docs.n;
+                }
+
+                static void read_list(freq_index const& index, size_t term,
+                                      encoded_sequence& docs, encoded_sequence& freqs,
+                                      uint64_t& occurrences)
+                {
+                    auto pro = index.read_list_prologue(term);
+                    occurrences = pro.occurrences;
+
+                    docs.bv = &index.m_docs_sequences.bits();
+                    docs.begin = pro.docs_offset;
+                    docs.end = index.m_docs_sequences.end_position(index.m_params, term);
+                    docs.universe = index.num_docs();
+                    docs.n = pro.n;
+
+                    freqs.bv = &index.m_freqs_sequences.bits();
+                    freqs.begin = pro.freqs_offset;
+                    freqs.end = index.m_freqs_sequences.end_position(index.m_params, term);
+                    freqs.universe = pro.occurrences + 1;
+                    freqs.n = pro.n;
+                }
+
+                virtual void prepare()
+                {
+                    write_gamma_nonzero(docs_bits, occurrences);
+                    if (occurrences > 1) {
+                        docs_bits.append_bits(n, ceil_log2(occurrences + 1));
+                    }
+
+                    DocsSequence::write_merged(docs_bits, a_docs, b_docs,
+                                               a_index.num_docs(), b.m_num_docs,
+                                               b.m_params);
+
+                    FreqsSequence::write_merged(freqs_bits, a_freqs, b_freqs,
+                                                a_occurrences, occurrences + 1,
+                                                b.m_params);
+                }
+
+                virtual void commit()
+                {
+                    b.m_docs_sequences.append(docs_bits);
+                    b.m_freqs_sequences.append(freqs_bits);
+                }
+
+                builder& b;
+                freq_index const& a_index;
+                freq_index const& b_index;
+                encoded_sequence a_docs, a_freqs, b_docs, b_freqs;
+                uint64_t a_occurrences;
+                uint64_t occurrences;
+                uint64_t n;
+                succinct::bit_vector_builder docs_bits;
+                succinct::bit_vector_builder freqs_bits;
+            };
+
             semiasync_queue m_queue;
             global_parameters m_params;
             uint64_t m_num_docs;
@@ -123,6 +239,7 @@ namespace quasi_succinct {
 
             void QS_FLATTEN_FUNC next()
             {
+                QS_COUNT(next);
                 auto val = m_docs_enum.next();
                 m_cur_pos = val.first;
                 m_cur_docid = val.second;
@@ -130,6 +247,7 @@ namespace quasi_succinct {
 
             void QS_FLATTEN_FUNC next_geq(uint64_t lower_bound)
             {
+                QS_COUNT(next_geq);
                 auto val = m_docs_enum.next_geq(lower_bound);
                 m_cur_pos = val.first;
                 m_cur_docid = val.second;
@@ -192,25 +310,10 @@ namespace quasi_succinct {
         document_enumerator operator[](size_t i) const
         {
             assert(i < size());
-            auto docs_it = m_docs_sequences.get(m_params, i);
-            uint64_t occurrences = read_gamma_nonzero(docs_it);
-            uint64_t n = 1;
-            if (occurrences > 1) {
-                n = docs_it.take(ceil_log2(occurrences + 1));
+            if (m_list_headers.size() && m_list_headers[i].n) {
+                return make_enumerator(m_list_headers[i]);
             }
-
-            typename DocsSequence::enumerator docs_enum(m_docs_sequences.bits(),
-                                                        docs_it.position(),
-                                                        num_docs(), n,
-                                                        m_params);
-
-            auto freqs_it = m_freqs_sequences.get(m_params, i);
-            typename FreqsSequence::enumerator freqs_enum(m_freqs_sequences.bits(),
-                                                          freqs_it.position(),
-                                                          occurrences + 1, n,
-                                                          m_params);
-
-            return document_enumerator(docs_enum, freqs_enum);
+            return make_enumerator(read_list_prologue(i));
         }
 
         global_parameters const& params() const
@@ -224,6 +327,7 @@ namespace quasi_succinct {
             std::swap(m_num_docs, other.m_num_docs);
             m_docs_sequences.swap(other.m_docs_sequences);
             m_freqs_sequences.swap(other.m_freqs_sequences);
+            m_list_headers.swap(other.m_list_headers);
         }
 
         template <typename Visitor>
@@ -235,12 +339,89 @@ namespace quasi_succinct {
                 (m_docs_sequences, "m_docs_sequences")
                 (m_freqs_sequences, "m_freqs_sequences")
                 ;
+            // absent from the indexes without headers, which keeps the
+            // files of the older formats mappable
+            if (m_params.list_headers) {
+                visit(m_list_headers, "m_list_headers");
+            }
         }
 
     private:
+
+        // the fields at the beginning of the docs and freqs lists
+        struct list_prologue {
+            uint64_t docs_offset;
+            uint64_t freqs_offset;
+            uint64_t occurrences;
+            uint64_t n;
+        };
+
+        list_prologue read_list_prologue(size_t i) const
+        {
+            list_prologue pro;
+            auto docs_it = m_docs_sequences.get(m_params, i);
+            pro.occurrences = read_gamma_nonzero(docs_it);
+            pro.n = 1;
+            if (pro.occurrences > 1) {
+                pro.n = docs_it.take(ceil_log2(pro.occurrences + 1));
+            }
+            pro.docs_offset = docs_it.position();
+            pro.freqs_offset = m_freqs_sequences.get(m_params, i).position();
+            return pro;
+        }
+
+        // The header is written to the index as is, so the padding is
+        // zeroed and only the fields are assigned afterwards
+        void read_list_header(size_t i, list_header& header) const
+        {
+            std::memset(&header, 0, sizeof(header));
+            auto pro = read_list_prologue(i);
+            if (pro.occurrences >= std::numeric_limits<uint32_t>::max()) {
+                return;
+            }
+            header.docs_offset = pro.docs_offset;
+            header.freqs_offset = pro.freqs_offset;
+            header.occurrences = pro.occurrences;
+            header.n = pro.n;
+
+            docs_header_traits::read(m_docs_sequences.bits(), pro.docs_offset,
+                                     num_docs(), pro.n, m_params, header.docs_header);
+            freqs_header_traits::read(m_freqs_sequences.bits(), pro.freqs_offset,
+                                      pro.occurrences + 1, pro.n, m_params,
+                                      header.freqs_header);
+        }
+
+        document_enumerator make_enumerator(list_prologue const& pro) const
+        {
+            typename DocsSequence::enumerator docs_enum(m_docs_sequences.bits(),
+                                                        pro.docs_offset,
+                                                        num_docs(), pro.n,
+                                                        m_params);
+            typename FreqsSequence::enumerator freqs_enum(m_freqs_sequences.bits(),
+                                                          pro.freqs_offset,
+                                                          pro.occurrences + 1, pro.n,
+                                                          m_params);
+            return document_enumerator(docs_enum, freqs_enum);
+        }
+
+        document_enumerator make_enumerator(list_header const& header) const
+        {
+            auto docs_enum = docs_header_traits::enumerator(m_docs_sequences.bits(),
+                                                            header.docs_offset,
+                                                            num_docs(), header.n,
+                                                            m_params, header.docs_header);
+            auto freqs_enum = freqs_header_traits::enumerator(m_freqs_sequences.bits(),
+                                                              header.freqs_offset,
+                                                              uint64_t(header.occurrences) + 1,
+                                                              header.n,
+                                                              m_params, header.freqs_header);
+            return document_enumerator(docs_enum, freqs_enum);
+        }
+
         global_parameters m_params;
         uint64_t m_num_docs;
         bitvector_collection m_docs_sequences;
         bitvector_collection m_freqs_sequences;
+        succinct::mapper::mappable_vector<list_header> m_list_headers;
     };
 }
@@ -1,19 +1,50 @@
 #pragma once
 
+#include <stdint.h>
+
+#include "access_time_model.hpp"
+
 namespace quasi_succinct {
 
     struct global_parameters {
+        // Serialized parameters before flat_endpoints and list_headers
+        // start directly with ef_log_sampling0, which is always below 64;
+        // the later formats start instead with a byte with the high bit
+        // set followed by the version, so that both can be mapped
+        static const uint8_t format_tag = 0x80;
+        static const uint8_t format_version = 1;
+
         global_parameters()
-            : ef_log_sampling0(9)
+            : format(format_tag | format_version)
+            , ef_log_sampling0(9)
             , ef_log_sampling1(8)
             , rb_log_rank1_sampling(9)
             , rb_log_sampling1(8)
             , log_partition_size(7)
+            , flat_endpoints(0)
+            , list_headers(0)
+            , space_time_lambda(0)
         {}
 
         template <typename Visitor>
         void map(Visitor& visit)
         {
+            visit(format, "format");
+            if (!(format & format_tag)) {
+                // legacy format: the byte just read is ef_log_sampling0
+                ef_log_sampling0 = format;
+                format = format_tag;
+                visit
+                    (ef_log_sampling1, "ef_log_sampling1")
+                    (rb_log_rank1_sampling, "rb_log_rank1_sampling")
+                    (rb_log_sampling1, "rb_log_sampling1")
+                    (log_partition_size, "log_partition_size")
+                    ;
+                flat_endpoints = 0;
+                list_headers = 0;
+                return;
+            }
+
             visit
                 (ef_log_sampling0, "ef_log_sampling0")
                 (ef_log_sampling1, "ef_log_sampling1")
@@ -21,13 +52,33 @@ namespace quasi_succinct {
                 (rb_log_sampling1, "rb_log_sampling1")
                 (log_partition_size, "log_partition_size")
                 ;
+            if ((format & ~format_tag) >= 1) {
+                visit
+                    (flat_endpoints, "flat_endpoints")
+                    (list_headers, "list_headers")
+                    ;
+            }
         }
 
+        // format tag and version, see map()
+        uint8_t format;
+
         uint8_t ef_log_sampling0;
         uint8_t ef_log_sampling1;
         uint8_t rb_log_rank1_sampling;
         uint8_t rb_log_sampling1;
         uint8_t log_partition_size;
+        // if nonzero, collection endpoints are stored as a fixed-width array
+        // instead of Elias-Fano, trading space for a single-load lookup
+        uint8_t flat_endpoints;
+        // if nonzero, freq_index stores a table of pre-parsed list headers
+        uint8_t list_headers;
+
+        // Construction only, not serialized: the encodings minimize their
+        // size plus space_time_lambda times the access time estimated by
+        // access_time (in bits per nanosecond); 0 minimizes space only
+        double space_time_lambda;
+        access_time_model access_time;
     };
 
 }
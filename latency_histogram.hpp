@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+
+#include "succinct/broadword.hpp"
+
+namespace quasi_succinct {
+
+    // Log-bucketed histogram of latencies (in microseconds), in the style
+    // of HdrHistogram: the values are recorded in nanoseconds, and each
+    // power of two range is split into 2^(sub_bucket_bits - 1) linear
+    // buckets, so that the quantiles have a relative error below
+    // 2^-(sub_bucket_bits - 1) (< 2% with the default 7 bits) whatever the
+    // range of the values. The memory is fixed (a few KB) and independent
+    // of the number of values, so tails like the 99.9% quantile can be
+    // computed over arbitrarily long runs.
+    class latency_histogram {
+    public:
+        static const uint64_t sub_bucket_bits = 7;
+
+        latency_histogram()
+            : m_counts(bucket_index(std::numeric_limits<uint64_t>::max()) + 1)
+        {
+            clear();
+        }
+
+        void clear()
+        {
+            std::fill(m_counts.begin(), m_counts.end(), 0);
+            m_count = 0;
+            m_sum = 0;
+            m_min = std::numeric_limits<double>::infinity();
+            m_max = 0;
+        }
+
+        void add(double usecs)
+        {
+            usecs = std::max(usecs, 0.0);
+            m_counts[bucket_index(to_nsecs(usecs))] += 1;
+            m_count += 1;
+            m_sum += usecs;
+            m_min = std::min(m_min, usecs);
+            m_max = std::max(m_max, usecs);
+        }
+
+        // Adds the values of other, for example of another thread
+        void merge(latency_histogram const& other)
+        {
+            for (size_t b = 0; b < m_counts.size(); ++b) {
+                m_counts[b] += other.m_counts[b];
+            }
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_min = std::min(m_min, other.m_min);
+            m_max = std::max(m_max, other.m_max);
+        }
+
+        uint64_t count() const
+        {
+            return m_count;
+        }
+
+        double mean() const
+        {
+            return m_count ? m_sum / double(m_count) : 0;
+        }
+
+        double min() const
+        {
+            return m_count ? m_min : 0;
+        }
+
+        double max() const
+        {
+            return m_max;
+        }
+
+        // Smallest recorded value v (up to the bucket resolution) such that
+        // a fraction q of the values is <= v
+        double quantile(double q) const
+        {
+            if (!m_count) return 0;
+            uint64_t rank = uint64_t(std::ceil(q * double(m_count)));
+            rank = std::min(std::max(rank, uint64_t(1)), m_count);
+            uint64_t seen = 0;
+            for (uint64_t b = 0; b < m_counts.size(); ++b) {
+                seen += m_counts[b];
+                if (seen >= rank) {
+                    // the upper end of the bucket, within the observed range
+                    double v = double(bucket_upper(b)) / 1000;
+                    return std::min(std::max(v, m_min), m_max);
+                }
+            }
+            return m_max;
+        }
+
+    private:
+
+        static uint64_t to_nsecs(double usecs)
+        {
+            double ns = usecs * 1000;
+            if (ns >= double(std::numeric_limits<uint64_t>::max())) {
+                return std::numeric_limits<uint64_t>::max();
+            }
+            return uint64_t(ns);
+        }
+
+        // values below 2^sub_bucket_bits have a bucket each; above, the
+        // value shifted to [2^(sub_bucket_bits - 1), 2^sub_bucket_bits)
+        // is the offset within the buckets of its power of two
+        static uint64_t bucket_index(uint64_t v)
+        {
+            const uint64_t half = uint64_t(1) << (sub_bucket_bits - 1);
+            if (v < (uint64_t(1) << sub_bucket_bits)) return v;
+            uint64_t shift = succinct::broadword::msb(v) - sub_bucket_bits + 1;
+            return shift * half + (v >> shift);
+        }
+
+        static uint64_t bucket_upper(uint64_t b)
+        {
+            const uint64_t half = uint64_t(1) << (sub_bucket_bits - 1);
+            if (b < (uint64_t(1) << sub_bucket_bits)) return b;
+            uint64_t shift = b / half - 1;
+            uint64_t mantissa = b - shift * half;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+        std::vector<uint64_t> m_counts;
+        uint64_t m_count;
+        double m_sum;
+        double m_min;
+        double m_max;
+    };
+
+}
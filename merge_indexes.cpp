@@ -0,0 +1,193 @@
+#include <iostream>
+#include <type_traits>
+
+#include <succinct/mapper.hpp>
+
+#include "configuration.hpp"
+#include "index_types.hpp"
+#include "util.hpp"
+
+using namespace quasi_succinct;
+
+// Merges two indexes over disjoint document ranges: the documents of the
+// second index follow those of the first. The opt lists are merged in
+// encoded form, copying the partitions of both lists and re-encoding only
+// the two partitions at the boundary, which are joined when that is
+// cheaper; the other freq_index types are decoded and re-encoded.
+
+template <typename IndexType>
+struct encoded_merge : std::false_type {};
+
+template <>
+struct encoded_merge<opt_index> : std::true_type {};
+
+// the construction-only parameters are not stored in the indexes, so
+// they are taken from the configuration as in create_freq_index
+global_parameters build_params(global_parameters params)
+{
+    params.space_time_lambda = configuration::get().space_time_lambda;
+    params.access_time = configuration::get().access_time;
+    return params;
+}
+
+template <typename IndexType>
+void merge_lists(IndexType const& a, IndexType const& b,
+                 IndexType& merged, std::true_type)
+{
+    auto const& pa = a.params();
+    auto const& pb = b.params();
+    // the copied partitions are only valid with the same sampling
+    if (pa.ef_log_sampling0 != pb.ef_log_sampling0 ||
+        pa.ef_log_sampling1 != pb.ef_log_sampling1 ||
+        pa.rb_log_rank1_sampling != pb.rb_log_rank1_sampling ||
+        pa.rb_log_sampling1 != pb.rb_log_sampling1) {
+        throw std::invalid_argument("The indexes have different sampling parameters");
+    }
+
+    typename IndexType::builder builder(a.num_docs() + b.num_docs(), build_params(pa));
+    size_t num_lists = std::max(a.size(), b.size());
+    for (size_t term = 0; term < num_lists; ++term) {
+        builder.add_merged_list(a, b, term);
+    }
+    builder.build(merged);
+}
+
+template <typename IndexType>
+void merge_lists(IndexType const& a, IndexType const& b,
+                 IndexType& merged, std::false_type)
+{
+    size_t num_lists = std::max(a.size(), b.size());
+    uint64_t postings = 0;
+    for (size_t term = 0; term < num_lists; ++term) {
+        if (term < a.size()) postings += a[term].size();
+        if (term < b.size()) postings += b[term].size();
+    }
+
+    // the builder reads the lists asynchronously, so they are decoded in
+    // buffers that are never reallocated
+    std::vector<uint64_t> docs, freqs;
+    docs.reserve(postings);
+    freqs.reserve(postings);
+    typename IndexType::builder builder(a.num_docs() + b.num_docs(), build_params(a.params()));
+    for (size_t term = 0; term < num_lists; ++term) {
+        size_t list_begin = docs.size();
+        uint64_t occurrences = 0;
+        auto decode = [&](IndexType const& index, uint64_t shift) {
+            if (term >= index.size()) return;
+            auto e = index[term];
+            for (size_t i = 0; i < e.size(); ++i, e.next()) {
+                docs.push_back(shift + e.docid());
+                freqs.push_back(e.freq());
+                occurrences += freqs.back();
+            }
+        };
+        decode(a, 0);
+        decode(b, a.num_docs());
+        builder.add_posting_list(docs.size() - list_begin,
+                                 docs.begin() + list_begin,
+                                 freqs.begin() + list_begin,
+                                 occurrences);
+    }
+    builder.build(merged);
+}
+
+template <typename IndexType>
+void verify_merged(IndexType const& a, IndexType const& b, IndexType const& merged)
+{
+    logger() << "Checking the merged index..." << std::endl;
+    for (size_t term = 0; term < merged.size(); ++term) {
+        auto e = merged[term];
+        auto check = [&](IndexType const& index, uint64_t shift) {
+            if (term >= index.size()) return;
+            auto src = index[term];
+            for (size_t i = 0; i < src.size(); ++i, src.next(), e.next()) {
+                if (e.docid() != shift + src.docid() || e.freq() != src.freq()) {
+                    logger() << "list " << term << " differs at docid "
+                             << shift + src.docid() << std::endl;
+                    exit(1);
+                }
+            }
+        };
+        check(a, 0);
+        check(b, a.num_docs());
+        if (e.docid() != merged.num_docs()) {
+            logger() << "list " << term << " is too long" << std::endl;
+            exit(1);
+        }
+    }
+    logger() << "Everything is OK!" << std::endl;
+}
+
+template <typename IndexType>
+void merge(const char* a_filename, const char* b_filename,
+           const char* output_filename, bool check, std::string const& type)
+{
+    IndexType a, b;
+    boost::iostreams::mapped_file_source ma(a_filename), mb(b_filename);
+    succinct::mapper::map(a, ma);
+    succinct::mapper::map(b, mb);
+
+    logger() << "Merging " << a.num_docs() << " + " << b.num_docs()
+             << " documents" << std::endl;
+    double tick = get_time_usecs();
+
+    IndexType merged;
+    merge_lists(a, b, merged, encoded_merge<IndexType>());
+    double merge_secs = (get_time_usecs() - tick) / 1000000;
+    succinct::mapper::freeze(merged, output_filename);
+    double total_secs = (get_time_usecs() - tick) / 1000000;
+
+    uint64_t input_bytes = ma.size() + mb.size();
+    uint64_t output_bytes = succinct::mapper::size_of(merged);
+    logger() << "Merged in " << merge_secs << " seconds, "
+             << total_secs << " with writing" << std::endl;
+
+    stats_line()
+        ("type", type)
+        ("encoded_merge", encoded_merge<IndexType>::value)
+        ("input_bytes", input_bytes)
+        ("output_bytes", output_bytes)
+        ("merge_time", merge_secs)
+        ("total_time", total_secs)
+        ("merge_gbps", input_bytes / merge_secs / 1e9)
+        ("total_gbps", input_bytes / total_secs / 1e9)
+        ;
+
+    if (check) {
+        verify_merged(a, b, merged);
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <first index> <second index> <output filename>"
+                  << " [--check]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    const char* a_filename = argv[2];
+    const char* b_filename = argv[3];
+    const char* output_filename = argv[4];
+    bool check = argc > 5 && std::string(argv[5]) == "--check";
+
+    // block indexes are not freq_index
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                           \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {                     \
+            merge<BOOST_PP_CAT(T, _index)>                              \
+                (a_filename, b_filename, output_filename, check, type); \
+            /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, (ef)(single)(uniform)(opt));
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown or unmergeable type " << type << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
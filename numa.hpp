@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Minimal NUMA support through sysfs and the raw system calls, so that
+    // libnuma is not needed. On machines without NUMA (or kernels without
+    // mbind) there is a single node with all the CPUs, and the memory
+    // placement requests are no-ops.
+    namespace numa {
+
+        // Parses a sysfs list such as "0-3,8,10-11"
+        inline std::vector<unsigned> parse_list(std::string const& s)
+        {
+            std::vector<unsigned> ret;
+            std::istringstream is(s);
+            std::string range;
+            while (std::getline(is, range, ',')) {
+                if (range.empty() || range == "\n") continue;
+                unsigned begin, end;
+                if (sscanf(range.c_str(), "%u-%u", &begin, &end) != 2) {
+                    if (sscanf(range.c_str(), "%u", &begin) != 1) continue;
+                    end = begin;
+                }
+                for (unsigned i = begin; i <= end; ++i) ret.push_back(i);
+            }
+            return ret;
+        }
+
+        inline std::string read_line(std::string const& path)
+        {
+            std::ifstream is(path);
+            std::string line;
+            std::getline(is, line);
+            return line;
+        }
+
+        struct node {
+            unsigned id;
+            std::vector<unsigned> cpus;
+        };
+
+        // The online nodes that have CPUs
+        inline std::vector<node> nodes()
+        {
+            std::vector<node> ret;
+            std::string const sysfs = "/sys/devices/system/node/";
+            for (unsigned id: parse_list(read_line(sysfs + "online"))) {
+                auto cpus = parse_list(read_line(sysfs + "node" + std::to_string(id) + "/cpulist"));
+                if (!cpus.empty()) ret.push_back(node {id, cpus});
+            }
+            if (ret.empty()) {
+                node n {0, {}};
+                unsigned cpus = std::max(1U, std::thread::hardware_concurrency());
+                for (unsigned c = 0; c < cpus; ++c) n.cpus.push_back(c);
+                ret.push_back(n);
+            }
+            return ret;
+        }
+
+        // Restricts the calling thread to the given CPUs
+        inline bool pin_thread(std::vector<unsigned> const& cpus)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto c: cpus) {
+                if (c < CPU_SETSIZE) CPU_SET(c, &set);
+            }
+            return sched_setaffinity(0, sizeof(set), &set) == 0;
+        }
+
+        enum class policy { bind, interleave };
+
+        // Sets the placement of the (not yet touched) pages in [addr, addr + len)
+        inline bool place_memory(void* addr, size_t len, std::vector<unsigned> const& node_ids,
+                                 policy p)
+        {
+            const size_t mask_bits = 1024;
+            std::vector<unsigned long> mask(mask_bits / (8 * sizeof(unsigned long)));
+            for (auto id: node_ids) {
+                if (id >= mask_bits) return false;
+                mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+            }
+            int mode = (p == policy::bind) ? MPOL_BIND : MPOL_INTERLEAVE;
+            return syscall(__NR_mbind, addr, len, mode, mask.data(), mask_bits + 1, 0) == 0;
+        }
+
+        // Anonymous copy of a buffer with the given placement, for
+        // example of a mapped index file
+        class buffer {
+        public:
+            buffer(char const* data, size_t size,
+                   std::vector<unsigned> const& node_ids, policy p)
+                : m_size(size)
+            {
+                // at least one page, so that empty files are handled
+                size_t len = std::max(size, size_t(1));
+                void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (addr == MAP_FAILED) {
+                    throw std::runtime_error("mmap failed");
+                }
+                m_data = static_cast<char*>(addr);
+                // the policy applies at the first touch, that is the copy
+                m_placed = place_memory(m_data, len, node_ids, p);
+                memcpy(m_data, data, size);
+            }
+
+            ~buffer()
+            {
+                munmap(m_data, std::max(m_size, size_t(1)));
+            }
+
+            buffer(buffer const&) = delete;
+            buffer& operator=(buffer const&) = delete;
+
+            char const* data() const
+            {
+                return m_data;
+            }
+
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            // false if the kernel refused the placement, in which case the
+            // pages follow the default policy
+            bool placed() const
+            {
+                return m_placed;
+            }
+
+        private:
+            char* m_data;
+            size_t m_size;
+            bool m_placed;
+        };
+    }
+}
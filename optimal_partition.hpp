@@ -3,6 +3,9 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -119,6 +122,129 @@ namespace quasi_succinct {
             std::reverse(partition.begin(), partition.end());
             cost_opt = min_cost[size];
         }
+
+        // Exact partitioning: evaluates every partition instead of the
+        // eps1/eps2 windows, in quadratic time. The targets are processed
+        // in blocks; the contributions to a block from the positions
+        // before it depend only on final costs, so they are computed by
+        // threads workers, each owning a stride of the targets, while the
+        // contributions from inside the block are added sequentially.
+        // The workers are started once per list, and wait for each block
+        // on a condition variable. Candidates are always scanned by
+        // increasing start, so the result does not depend on the number
+        // of threads.
+        template <typename ForwardIterator, typename CostFunction>
+        optimal_partition(ForwardIterator begin, uint64_t universe, uint64_t size,
+                          CostFunction cost_fun, size_t threads)
+        {
+            std::vector<uint64_t> values(size);
+            std::vector<uint64_t> bases(size);
+            ForwardIterator it = begin;
+            for (posting_t i = 0; i < size; ++i, ++it) {
+                values[i] = *it;
+                bases[i] = i ? values[i - 1] + 1 : values[0];
+            }
+
+            std::vector<cost_t> min_cost(size + 1, cost_fun(universe, size));
+            min_cost[0] = 0;
+            std::vector<posting_t> path(size + 1, 0);
+
+            auto relax = [&](posting_t j, posting_t start_begin, posting_t start_end) {
+                uint64_t max_p = values[j - 1];
+                cost_t best_cost = min_cost[j];
+                posting_t best_start = path[j];
+                for (posting_t i = start_begin; i < start_end; ++i) {
+                    cost_t cost = min_cost[i] + cost_fun(max_p - bases[i] + 1, j - i);
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_start = i;
+                    }
+                }
+                min_cost[j] = best_cost;
+                path[j] = best_start;
+            };
+
+            const posting_t block_size = 1024;
+            auto relax_stride = [&](posting_t block_begin, posting_t block_end,
+                                    posting_t first, posting_t step) {
+                for (posting_t j = first; j < block_end; j += step) {
+                    relax(j, 0, block_begin);
+                }
+            };
+
+            // the caller is the worker of the first stride; the others
+            // run the block published with the next generation, and the
+            // last one to finish wakes up the caller
+            threads = std::max(threads, size_t(1));
+            if (size <= block_size) threads = 1; // a single block
+            std::mutex mutex;
+            std::condition_variable start_cond, done_cond;
+            uint64_t generation = 0;
+            size_t running = 0;
+            bool stop = false;
+            posting_t cur_begin = 0, cur_end = 0;
+
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                        uint64_t seen = 0;
+                        std::unique_lock<std::mutex> lock(mutex);
+                        while (true) {
+                            start_cond.wait(lock, [&] { return stop || generation != seen; });
+                            if (stop) return;
+                            seen = generation;
+                            posting_t block_begin = cur_begin, block_end = cur_end;
+                            lock.unlock();
+                            relax_stride(block_begin, block_end,
+                                         posting_t(block_begin + t), posting_t(threads));
+                            lock.lock();
+                            if (--running == 0) done_cond.notify_one();
+                        }
+                    });
+            }
+
+            for (posting_t block_begin = 1; block_begin <= size; block_begin += block_size) {
+                posting_t block_end = posting_t(std::min(uint64_t(block_begin) + block_size,
+                                                         size + 1));
+
+                if (workers.empty() || block_begin == 1) {
+                    relax_stride(block_begin, block_end, block_begin, 1);
+                } else {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        cur_begin = block_begin;
+                        cur_end = block_end;
+                        running = workers.size();
+                        generation += 1;
+                    }
+                    start_cond.notify_all();
+                    relax_stride(block_begin, block_end, block_begin, posting_t(threads));
+                    std::unique_lock<std::mutex> lock(mutex);
+                    done_cond.wait(lock, [&] { return running == 0; });
+                }
+
+                for (posting_t j = block_begin; j < block_end; ++j) {
+                    relax(j, block_begin, j);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            start_cond.notify_all();
+            for (auto& worker: workers) {
+                worker.join();
+            }
+
+            posting_t curr_pos = size;
+            while( curr_pos != 0 ) {
+                partition.push_back(curr_pos);
+                curr_pos = path[curr_pos];
+            }
+            std::reverse(partition.begin(), partition.end());
+            cost_opt = min_cost[size];
+        }
     };
 
 }
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <numeric>
+
+#include "configuration.hpp"
+#include "binary_freq_collection.hpp"
+#include "partitioned_sequence.hpp"
+#include "strict_sequence.hpp"
+#include "util.hpp"
+
+using namespace quasi_succinct;
+
+// Reports how much space the eps1/eps2 approximation of the optimal
+// partitioning loses with respect to the exact partitioning, for the docs
+// and freqs sequences of the opt index. The exact partitioning is
+// quadratic, so only the lists up to a given length are compared.
+
+struct partition_loss {
+    partition_loss()
+        : lists(0)
+        , postings(0)
+        , approx_bits(0)
+        , exact_bits(0)
+    {}
+
+    template <typename Sequence, typename Iterator>
+    void add(Iterator begin, uint64_t universe, uint64_t n,
+             global_parameters const& params)
+    {
+        lists += 1;
+        postings += n;
+        approx_bits += Sequence::compute_partition(begin, universe, n, params, false).cost_opt;
+        exact_bits += Sequence::compute_partition(begin, universe, n, params, true).cost_opt;
+    }
+
+    void dump(std::string const& sequences) const
+    {
+        stats_line()
+            ("sequences", sequences)
+            ("lists", lists)
+            ("postings", postings)
+            ("approx_bits_per_posting", double(approx_bits) / postings)
+            ("exact_bits_per_posting", double(exact_bits) / postings)
+            ("loss_bits_per_posting", double(approx_bits - exact_bits) / postings)
+            ("loss_ratio", double(approx_bits - exact_bits) / exact_bits)
+            ;
+    }
+
+    uint64_t lists;
+    uint64_t postings;
+    uint64_t approx_bits;
+    uint64_t exact_bits;
+};
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <collection basename> [<max list length>]"
+                  << std::endl;
+        return 1;
+    }
+
+    auto const& conf = configuration::get();
+    binary_freq_collection input(argv[1]);
+    uint64_t max_length = conf.exact_partition_max ? conf.exact_partition_max : 1 << 14;
+    if (argc > 2) {
+        max_length = boost::lexical_cast<uint64_t>(argv[2]);
+    }
+
+    global_parameters params;
+    params.ef_log_sampling0 = conf.ef_log_sampling0;
+    params.ef_log_sampling1 = conf.ef_log_sampling1;
+    params.rb_log_rank1_sampling = conf.rb_log_rank1_sampling;
+    params.rb_log_sampling1 = conf.rb_log_sampling1;
+
+    logger() << "Comparing the partitions of the lists up to "
+             << max_length << " postings" << std::endl;
+    double tick = get_time_usecs();
+
+    partition_loss docs_loss, freqs_loss;
+    uint64_t skipped = 0;
+    std::vector<uint64_t> cumulative_freqs;
+    for (auto const& plist: input) {
+        uint64_t n = plist.docs.size();
+        if (n > max_length) {
+            skipped += 1;
+            continue;
+        }
+
+        docs_loss.add<partitioned_sequence<>>(plist.docs.begin(), input.num_docs(),
+                                              n, params);
+
+        // the freqs are stored as prefix sums, see positive_sequence
+        cumulative_freqs.clear();
+        std::partial_sum(plist.freqs.begin(), plist.freqs.end(),
+                         std::back_inserter(cumulative_freqs));
+        freqs_loss.add<partitioned_sequence<strict_sequence>>(cumulative_freqs.begin(),
+                                                              cumulative_freqs.back() + 1,
+                                                              n, params);
+    }
+
+    logger() << "Skipped " << skipped << " longer lists, compared in "
+             << (get_time_usecs() - tick) / 1000000 << " seconds" << std::endl;
+    docs_loss.dump("docs");
+    freqs_loss.dump("freqs");
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits>
 #include <stdexcept>
 
 #include "configuration.hpp"
@@ -7,6 +8,8 @@
 #include "compact_elias_fano.hpp"
 #include "indexed_sequence.hpp"
 #include "integer_codes.hpp"
+#include "query_counters.hpp"
+#include "sequence_header.hpp"
 #include "util.hpp"
 #include "optimal_partition.hpp"
 
@@ -18,6 +21,34 @@ namespace quasi_succinct {
         typedef BaseSequence base_sequence_type;
         typedef typename base_sequence_type::enumerator base_sequence_enumerator;
 
+        // The partition used by write(), exact or with the eps1/eps2
+        // approximation
+        template <typename Iterator>
+        static optimal_partition compute_partition(Iterator begin,
+                                                   uint64_t universe, uint64_t n,
+                                                   global_parameters const& params,
+                                                   bool exact)
+        {
+            auto const& conf = configuration::get();
+
+            // in space-time mode each partition also pays the estimated
+            // time of a partition switch
+            uint64_t partition_cost = conf.fix_cost +
+                time_cost(params.space_time_lambda, params.access_time.partition_ns);
+            auto cost_fun = [&](uint64_t universe, uint64_t n) {
+                return base_sequence_type::space_time_cost(params, universe, n,
+                                                           params.access_time,
+                                                           params.space_time_lambda)
+                    + partition_cost;
+            };
+
+            if (exact) {
+                return optimal_partition(begin, universe, n, cost_fun,
+                                         conf.partition_threads);
+            }
+            return optimal_partition(begin, universe, n, cost_fun, conf.eps1, conf.eps2);
+        }
+
         template <typename Iterator>
         static void write(succinct::bit_vector_builder& bvb,
                           Iterator begin,
@@ -27,11 +58,8 @@ namespace quasi_succinct {
             assert(n > 0);
             auto const& conf = configuration::get();
 
-            auto cost_fun = [&](uint64_t universe, uint64_t n) {
-                return base_sequence_type::bitsize(params, universe, n) + conf.fix_cost;
-            };
-
-            optimal_partition opt(begin, universe, n, cost_fun, conf.eps1, conf.eps2);
+            optimal_partition opt = compute_partition(begin, universe, n, params,
+                                                      n <= conf.exact_partition_max);
 
             size_t partitions = opt.partition.size();
             assert(partitions > 0);
@@ -119,6 +147,222 @@ namespace quasi_succinct {
             }
         }
 
+        // Writes the sequence a followed by the sequence b shifted by
+        // shift, with the given universe. The partitions are copied as
+        // they are, since they are encoded relative to their base; only
+        // the two partitions at the boundary are re-encoded, along with
+        // the header
+        static void write_merged(succinct::bit_vector_builder& bvb,
+                                 encoded_sequence const& a,
+                                 encoded_sequence const& b,
+                                 uint64_t shift, uint64_t universe,
+                                 global_parameters const& params)
+        {
+            assert(a.n + b.n > 0);
+            std::vector<encoded_partition> parts;
+            uint64_t first_value = 0;
+            if (a.n) {
+                read_partitions(a, 0, 0, params, parts, first_value);
+            }
+            size_t b_first_part = parts.size();
+            if (b.n) {
+                uint64_t b_first_value;
+                read_partitions(b, a.n, shift, params, parts, b_first_value);
+                if (!a.n) first_value = b_first_value;
+            }
+            uint64_t n = a.n + b.n;
+
+            // the boundary partitions: the last of a, and the first of b,
+            // whose base becomes the successor of the last value of a.
+            // They are re-encoded, joined if this is cheaper under the
+            // cost model of the partitioning
+            succinct::bit_vector reencoded;
+            if (a.n && b.n) {
+                auto& a_part = parts[b_first_part - 1];
+                auto& b_part = parts[b_first_part];
+                uint64_t a_begin = b_first_part > 1 ? parts[b_first_part - 2].end_position : 0;
+                uint64_t a_base = b_first_part > 1 ? parts[b_first_part - 2].upper_bound + 1
+                                                   : first_value;
+                uint64_t b_base = a_part.upper_bound + 1;
+                uint64_t a_part_n = a.n - a_begin;
+                uint64_t b_part_n = b_part.end_position - a.n;
+
+                uint64_t separate_cost =
+                    base_sequence_type::bitsize(params, a_part.upper_bound - a_base + 1, a_part_n)
+                    + base_sequence_type::bitsize(params, b_part.upper_bound - b_base + 1, b_part_n)
+                    + configuration::get().fix_cost;
+                uint64_t joined_cost =
+                    base_sequence_type::bitsize(params, b_part.upper_bound - a_base + 1,
+                                                a_part_n + b_part_n);
+                bool join = joined_cost <= separate_cost;
+
+                std::vector<uint64_t> values;
+                uint64_t part_base = b_base;
+                if (join) {
+                    part_base = a_base;
+                    enumerator e(*a.bv, a.begin, a.universe, a.n, params);
+                    values.push_back(e.move(a_begin).second - part_base);
+                    for (uint64_t i = 1; i < a_part_n; ++i) {
+                        values.push_back(e.next().second - part_base);
+                    }
+                }
+                enumerator e(*b.bv, b.begin, b.universe, b.n, params);
+                values.push_back(e.move(0).second + shift - part_base);
+                for (uint64_t i = 1; i < b_part_n; ++i) {
+                    values.push_back(e.next().second + shift - part_base);
+                }
+
+                succinct::bit_vector_builder part_bits;
+                base_sequence_type::write(part_bits, values.begin(),
+                                          values.back() + 1, values.size(), params);
+                succinct::bit_vector(&part_bits).swap(reencoded);
+                b_part.bv = &reencoded;
+                b_part.begin_bit = 0;
+                b_part.end_bit = reencoded.size();
+                if (join) {
+                    parts.erase(parts.begin() + (b_first_part - 1));
+                }
+            }
+
+            // same layout as write()
+            size_t partitions = parts.size();
+            write_gamma_nonzero(bvb, partitions);
+            if (partitions == 1) {
+                auto const& part = parts.front();
+                bvb.append_bits(first_value, ceil_log2(universe));
+                if (n > 1) {
+                    if (part.upper_bound + 1 == universe) {
+                        write_delta(bvb, 0);
+                    } else {
+                        write_delta(bvb, part.upper_bound - first_value);
+                    }
+                }
+                append_bit_range(bvb, *part.bv, part.begin_bit, part.end_bit);
+                return;
+            }
+
+            std::vector<uint64_t> sizes;
+            std::vector<uint64_t> upper_bounds;
+            std::vector<uint64_t> endpoints;
+            upper_bounds.push_back(first_value);
+            uint64_t sequences_bits = 0;
+            for (auto const& part: parts) {
+                sizes.push_back(part.end_position);
+                upper_bounds.push_back(part.upper_bound);
+                sequences_bits += part.end_bit - part.begin_bit;
+                endpoints.push_back(sequences_bits);
+            }
+
+            succinct::bit_vector_builder bv_sizes;
+            compact_elias_fano::write(bv_sizes, sizes.begin(),
+                                      n, partitions - 1,
+                                      params);
+
+            succinct::bit_vector_builder bv_upper_bounds;
+            compact_elias_fano::write(bv_upper_bounds, upper_bounds.begin(),
+                                      universe, partitions + 1,
+                                      params);
+
+            uint64_t endpoint_bits = ceil_log2(sequences_bits + 1);
+            write_gamma(bvb, endpoint_bits);
+
+            bvb.append(bv_sizes);
+            bvb.append(bv_upper_bounds);
+
+            for (uint64_t p = 0; p < endpoints.size() - 1; ++p) {
+                bvb.append_bits(endpoints[p], endpoint_bits);
+            }
+
+            for (auto const& part: parts) {
+                append_bit_range(bvb, *part.bv, part.begin_bit, part.end_bit);
+            }
+        }
+
+        // variable-length fields at the beginning of the sequence
+        struct prologue {
+            uint64_t value; // base if single partition, else endpoint bits
+            uint64_t upper_bound; // relative upper bound if single partition
+            uint64_t partitions;
+            uint64_t bits; // prologue length
+        };
+
+        static prologue read_prologue(succinct::bit_vector const& bv, uint64_t offset,
+                                      uint64_t universe, uint64_t n)
+        {
+            prologue pro;
+            succinct::bit_vector::enumerator it(bv, offset);
+            pro.partitions = read_gamma_nonzero(it);
+            pro.upper_bound = 0;
+            if (pro.partitions == 1) {
+                uint64_t universe_bits = ceil_log2(universe);
+                pro.value = it.take(universe_bits);
+                if (n > 1) {
+                    uint64_t universe_delta = read_delta(it);
+                    pro.upper_bound = universe_delta
+                        ? universe_delta
+                        : (universe - pro.value - 1);
+                }
+            } else {
+                pro.value = read_gamma(it);
+            }
+            pro.bits = it.position() - offset;
+            return pro;
+        }
+
+        // The prologue and the first partition, with which the enumerator
+        // is positioned without reading the partition sizes and upper
+        // bounds. The fields are 32 bits to keep the per-list headers of
+        // freq_index small; if the universe or the size do not fit,
+        // partitions is 0 and the enumerator parses the sequence instead.
+        struct header_type {
+            uint32_t partitions;
+            uint32_t first_end; // size of the first partition
+            uint32_t base; // of the first partition
+            uint32_t upper_bound; // of the first partition, relative to base
+            uint8_t endpoint_bits;
+            uint8_t bits; // prologue length
+        };
+
+        // Assigns all the fields of header and leaves its padding untouched,
+        // so that the caller can zero it before storing the header
+        static void read_header(succinct::bit_vector const& bv, uint64_t offset,
+                                uint64_t universe, uint64_t n,
+                                global_parameters const& params,
+                                header_type& header)
+        {
+            header.partitions = 0;
+            header.first_end = 0;
+            header.base = 0;
+            header.upper_bound = 0;
+            header.endpoint_bits = 0;
+            header.bits = 0;
+            if (universe > std::numeric_limits<uint32_t>::max() ||
+                n > std::numeric_limits<uint32_t>::max()) {
+                return;
+            }
+
+            prologue pro = read_prologue(bv, offset, universe, n);
+            header.partitions = pro.partitions;
+            header.bits = pro.bits;
+            if (pro.partitions == 1) {
+                header.first_end = n;
+                header.base = pro.value;
+                header.upper_bound = pro.upper_bound;
+            } else {
+                header.endpoint_bits = pro.value;
+                uint64_t cur_offset = offset + pro.bits;
+                compact_elias_fano::enumerator sizes(bv, cur_offset,
+                                                     n, pro.partitions - 1, params);
+                cur_offset += compact_elias_fano::bitsize(params, n, pro.partitions - 1);
+                compact_elias_fano::enumerator upper_bounds(bv, cur_offset,
+                                                            universe, pro.partitions + 1,
+                                                            params);
+                header.first_end = sizes.move(0).second;
+                header.base = upper_bounds.move(0).second;
+                header.upper_bound = upper_bounds.move(1).second - header.base;
+            }
+        }
+
         class enumerator {
         public:
 
@@ -135,50 +379,46 @@ namespace quasi_succinct {
                 , m_universe(universe)
                 , m_bv(&bv)
             {
-                succinct::bit_vector::enumerator it(bv, offset);
-                m_partitions = read_gamma_nonzero(it);
-                if (m_partitions == 1) {
-                    m_cur_partition = 0;
-                    m_cur_begin = 0;
-                    m_cur_end = n;
-
-                    uint64_t universe_bits = ceil_log2(universe);
-                    m_cur_base = it.take(universe_bits);
-                    auto ub = 0;
-                    if (n > 1) {
-                        uint64_t universe_delta = read_delta(it);
-                        ub = universe_delta ? universe_delta : (universe - m_cur_base - 1);
-                    }
-
-                    m_partition_enum = base_sequence_enumerator
-                        (*m_bv, it.position(), ub + 1, n, m_params);
-
-                    m_cur_upper_bound = m_cur_base + ub;
-                } else {
-                    m_endpoint_bits = read_gamma(it);
-
-                    uint64_t cur_offset = it.position();
-                    m_sizes = compact_elias_fano::enumerator(bv, cur_offset,
-                                                             n, m_partitions - 1,
-                                                             params);
-                    cur_offset += compact_elias_fano::bitsize(params, n,
-                                                              m_partitions - 1);
+                init(offset, read_prologue(bv, offset, universe, n));
+                m_position = size();
+                slow_move();
+            }
 
-                    m_upper_bounds = compact_elias_fano::enumerator(bv, cur_offset,
-                                                                    universe, m_partitions + 1,
-                                                                    params);
-                    cur_offset += compact_elias_fano::bitsize(params, universe,
-                                                              m_partitions + 1);
+            enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                       uint64_t universe, uint64_t n,
+                       global_parameters const& params,
+                       header_type const& header)
+                : m_params(params)
+                , m_size(n)
+                , m_universe(universe)
+                , m_bv(&bv)
+            {
+                if (!header.partitions) {
+                    *this = enumerator(bv, offset, universe, n, params);
+                    return;
+                }
 
-                    m_endpoints_offset = cur_offset;
-                    uint64_t endpoints_size = m_endpoint_bits * (m_partitions - 1);
-                    cur_offset += endpoints_size;
+                prologue pro;
+                pro.partitions = header.partitions;
+                pro.bits = header.bits;
+                pro.value = (header.partitions == 1) ? header.base : header.endpoint_bits;
+                pro.upper_bound = header.upper_bound;
+                init(offset, pro);
 
-                    m_sequences_offset = cur_offset;
+                if (m_partitions > 1) {
+                    // the first partition starts at the sequences
+                    m_cur_partition = 0;
+                    m_cur_begin = 0;
+                    m_cur_end = header.first_end;
+                    m_cur_base = header.base;
+                    m_cur_upper_bound = m_cur_base + header.upper_bound;
+                    m_partition_enum = base_sequence_enumerator
+                        (*m_bv, m_sequences_offset, header.upper_bound + 1,
+                         m_cur_end, m_params);
                 }
-
+                // like after a move to the end; move() starts from the
+                // first partition without a lookup
                 m_position = size();
-                slow_move();
             }
 
             value_type QS_ALWAYSINLINE move(uint64_t position)
@@ -235,10 +475,78 @@ namespace quasi_succinct {
                 return m_partitions;
             }
 
+            // view of the partition containing the current position
+            struct partition_view {
+                typename base_sequence_type::index_type type;
+                uint64_t begin; // positions [begin, end)
+                uint64_t end;
+                uint64_t base; // values [base, upper_bound]
+                uint64_t upper_bound;
+                // if type is ranked_bitvector, the bit at bitmap_offset + v -
+                // base of bv is set iff v is in the partition
+                succinct::bit_vector const* bv;
+                uint64_t bitmap_offset;
+            };
+
+            // note: this is instantiated only if BaseSequence is indexed_sequence
+            partition_view partition() const
+            {
+                partition_view view;
+                view.type = m_partition_enum.type();
+                view.begin = m_cur_begin;
+                view.end = m_cur_end;
+                view.base = m_cur_base;
+                view.upper_bound = m_cur_upper_bound;
+                view.bv = m_bv;
+                view.bitmap_offset = (view.type == base_sequence_type::ranked_bitvector)
+                    ? m_partition_enum.bitmap_offset()
+                    : 0;
+                return view;
+            }
+
             friend class partitioned_sequence_test;
 
         private:
 
+            void init(uint64_t offset, prologue const& pro)
+            {
+                m_partitions = pro.partitions;
+                uint64_t cur_offset = offset + pro.bits;
+                if (m_partitions == 1) {
+                    m_cur_partition = 0;
+                    m_cur_begin = 0;
+                    m_cur_end = m_size;
+
+                    m_cur_base = pro.value;
+                    uint64_t ub = pro.upper_bound;
+
+                    m_partition_enum = base_sequence_enumerator
+                        (*m_bv, cur_offset, ub + 1, m_size, m_params);
+
+                    m_cur_upper_bound = m_cur_base + ub;
+                } else {
+                    m_endpoint_bits = pro.value;
+
+                    m_sizes = compact_elias_fano::enumerator(*m_bv, cur_offset,
+                                                             m_size, m_partitions - 1,
+                                                             m_params);
+                    cur_offset += compact_elias_fano::bitsize(m_params, m_size,
+                                                              m_partitions - 1);
+
+                    m_upper_bounds = compact_elias_fano::enumerator(*m_bv, cur_offset,
+                                                                    m_universe, m_partitions + 1,
+                                                                    m_params);
+                    cur_offset += compact_elias_fano::bitsize(m_params, m_universe,
+                                                              m_partitions + 1);
+
+                    m_endpoints_offset = cur_offset;
+                    uint64_t endpoints_size = m_endpoint_bits * (m_partitions - 1);
+                    cur_offset += endpoints_size;
+
+                    m_sequences_offset = cur_offset;
+                }
+            }
+
             // the compiler does not seem smart enough to figure out that this
             // is a very unlikely condition, and inlines the move(0) inside the
             // next(), causing the code to grow. Since next is called in very
@@ -299,6 +607,7 @@ namespace quasi_succinct {
             void switch_partition(uint64_t partition)
             {
                 assert(m_partitions > 1);
+                QS_COUNT(partition_switches);
 
                 uint64_t endpoint = partition
                     ? (m_bv->get_word56(m_endpoints_offset +
@@ -345,5 +654,74 @@ namespace quasi_succinct {
             compact_elias_fano::enumerator m_upper_bounds;
             base_sequence_enumerator m_partition_enum;
         };
+
+    private:
+
+        struct encoded_partition {
+            uint64_t end_position; // past the last element
+            uint64_t upper_bound;
+            succinct::bit_vector const* bv;
+            uint64_t begin_bit; // bits [begin_bit, end_bit) of bv
+            uint64_t end_bit;
+        };
+
+        // appends the partitions of seq, with positions shifted by
+        // position_shift and values by shift
+        static void read_partitions(encoded_sequence const& seq,
+                                    uint64_t position_shift, uint64_t shift,
+                                    global_parameters const& params,
+                                    std::vector<encoded_partition>& parts,
+                                    uint64_t& first_value)
+        {
+            auto const& bv = *seq.bv;
+            prologue pro = read_prologue(bv, seq.begin, seq.universe, seq.n);
+            uint64_t offset = seq.begin + pro.bits;
+
+            if (pro.partitions == 1) {
+                first_value = pro.value + shift;
+                parts.push_back(encoded_partition {
+                        position_shift + seq.n,
+                        first_value + pro.upper_bound,
+                        &bv, offset, seq.end });
+                return;
+            }
+
+            uint64_t endpoint_bits = pro.value;
+            compact_elias_fano::enumerator sizes(bv, offset, seq.n,
+                                                 pro.partitions - 1, params);
+            offset += compact_elias_fano::bitsize(params, seq.n, pro.partitions - 1);
+            compact_elias_fano::enumerator upper_bounds(bv, offset, seq.universe,
+                                                        pro.partitions + 1, params);
+            offset += compact_elias_fano::bitsize(params, seq.universe,
+                                                  pro.partitions + 1);
+            uint64_t endpoints_offset = offset;
+            uint64_t sequences_offset = offset + endpoint_bits * (pro.partitions - 1);
+
+            first_value = upper_bounds.move(0).second + shift;
+            uint64_t begin = sequences_offset;
+            for (uint64_t p = 0; p < pro.partitions; ++p) {
+                bool last = p + 1 == pro.partitions;
+                uint64_t end = last ? seq.end
+                    : sequences_offset + bv.get_bits(endpoints_offset + p * endpoint_bits,
+                                                     endpoint_bits);
+                parts.push_back(encoded_partition {
+                        position_shift + (last ? seq.n : sizes.move(p).second),
+                        upper_bounds.move(p + 1).second + shift,
+                        &bv, begin, end });
+                begin = end;
+            }
+        }
+
+        static void append_bit_range(succinct::bit_vector_builder& bvb,
+                                     succinct::bit_vector const& bv,
+                                     uint64_t begin, uint64_t end)
+        {
+            for (; begin + 64 <= end; begin += 64) {
+                bvb.append_bits(bv.get_word(begin), 64);
+            }
+            if (begin < end) {
+                bvb.append_bits(bv.get_bits(begin, end - begin), end - begin);
+            }
+        }
     };
 }
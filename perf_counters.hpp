@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Hardware performance counters of the calling thread, read with
+    // perf_event_open. Each event is opened on its own, so that the events
+    // the CPU (or the kernel's perf_event_paranoid setting) does not allow
+    // are just skipped; when the PMU has fewer counters than events the
+    // kernel multiplexes them, and the values are scaled by the fraction
+    // of the time they were actually counting.
+    class perf_counters {
+    public:
+        perf_counters()
+        {
+            add_event("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            add_event("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            add_event("branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+            add_event("l1d_misses", PERF_TYPE_HW_CACHE,
+                      cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            add_event("llc_misses", PERF_TYPE_HW_CACHE,
+                      cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            add_event("dtlb_misses", PERF_TYPE_HW_CACHE,
+                      cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        }
+
+        ~perf_counters()
+        {
+            for (auto const& e: m_events) {
+                close(e.fd);
+            }
+        }
+
+        perf_counters(perf_counters const&) = delete;
+        perf_counters& operator=(perf_counters const&) = delete;
+
+        // false if no event could be opened
+        bool available() const
+        {
+            return !m_events.empty();
+        }
+
+        void start()
+        {
+            for (auto const& e: m_events) {
+                ioctl(e.fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(e.fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        void stop()
+        {
+            for (auto const& e: m_events) {
+                ioctl(e.fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+
+        // Emits the counts since start(), divided by n, in a stats_line
+        void dump(stats_line& line, uint64_t n = 1) const
+        {
+            for (auto const& e: m_events) {
+                uint64_t values[3]; // value, time enabled, time running
+                if (read(e.fd, values, sizeof(values)) != sizeof(values)) {
+                    continue;
+                }
+                double value = double(values[0]);
+                if (values[2] && values[2] < values[1]) {
+                    value *= double(values[1]) / double(values[2]);
+                }
+                line(e.name, value / double(n));
+            }
+        }
+
+    private:
+
+        static uint64_t cache_event(uint64_t cache, uint64_t result)
+        {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+        }
+
+        void add_event(std::string const& name, uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd < 0) {
+                return;
+            }
+            m_events.push_back(event {name, fd});
+        }
+
+        struct event {
+            std::string name;
+            int fd;
+        };
+
+        std::vector<event> m_events;
+    };
+
+}
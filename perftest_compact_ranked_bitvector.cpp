@@ -0,0 +1,144 @@
+#include <iostream>
+#include <random>
+
+#include <boost/lexical_cast.hpp>
+
+#include "compact_ranked_bitvector.hpp"
+#include "bit_scan.hpp"
+#include "util.hpp"
+
+using namespace quasi_succinct;
+
+std::vector<uint64_t> random_bits_sequence(uint64_t universe, double density,
+                                           std::mt19937_64& rng)
+{
+    std::bernoulli_distribution coin(density);
+    std::vector<uint64_t> seq;
+    for (uint64_t v = 0; v < universe; ++v) {
+        if (coin(rng)) seq.push_back(v);
+    }
+    return seq;
+}
+
+template <typename Functor>
+double time_ns_per_call(size_t calls, Functor f)
+{
+    auto tick = get_time_usecs();
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < calls; ++i) {
+        checksum += f(i);
+    }
+    do_not_optimize_away(checksum);
+    return (get_time_usecs() - tick) * 1000 / calls;
+}
+
+void perftest_kernels(succinct::bit_vector const& bv, double density,
+                      std::mt19937_64& rng)
+{
+    uint64_t const* data = bv.data().data();
+    size_t calls = 1 << 20;
+    for (uint64_t range: {64, 256, 512, 2048}) {
+        std::vector<uint64_t> begins(calls);
+        std::uniform_int_distribution<uint64_t> dist(0, bv.size() - range - 1);
+        for (auto& b: begins) b = dist(rng);
+
+        auto popcount_fun = [&](uint64_t (*fun)(uint64_t const*, uint64_t, uint64_t)) {
+            return time_ns_per_call(calls, [&](size_t i) {
+                    return fun(data, begins[i], begins[i] + range);
+                });
+        };
+
+        stats_line()
+            ("kernel", "popcount")
+            ("density", density)
+            ("range", range)
+            ("scalar_ns", popcount_fun(bit_scan::popcount_scalar))
+            ("dispatch_ns", popcount_fun(bit_scan::popcount))
+            ("avx2", bit_scan::has_avx2())
+            ;
+    }
+
+    // next_one from random positions, bounded by the last set bit
+    uint64_t last_one = bv.predecessor1(bv.size() - 1);
+    std::vector<uint64_t> positions(calls);
+    std::uniform_int_distribution<uint64_t> dist(0, last_one);
+    for (auto& p: positions) p = dist(rng);
+
+    auto next_one_fun = [&](uint64_t (*fun)(uint64_t const*, uint64_t, uint64_t)) {
+        return time_ns_per_call(calls, [&](size_t i) {
+                return fun(data, positions[i], last_one + 1);
+            });
+    };
+
+    stats_line()
+        ("kernel", "next_one")
+        ("density", density)
+        ("scalar_ns", next_one_fun(bit_scan::next_one_scalar))
+        ("dispatch_ns", next_one_fun(bit_scan::next_one))
+        ("avx2", bit_scan::has_avx2())
+        ;
+}
+
+void perftest_next_geq(std::vector<uint64_t> const& seq, uint64_t universe,
+                       double density)
+{
+    global_parameters params;
+    succinct::bit_vector_builder bvb;
+    compact_ranked_bitvector::write(bvb, seq.begin(), universe, seq.size(), params);
+    succinct::bit_vector bv(&bvb);
+
+    for (uint64_t skip: {16, 64, 256, 1024, 8192}) {
+        compact_ranked_bitvector::enumerator e(bv, 0, universe, seq.size(), params);
+        std::vector<uint64_t> targets;
+        for (uint64_t v = 0; v < universe; v += skip) {
+            targets.push_back(v);
+        }
+
+        e.move(0);
+        double ns = time_ns_per_call(targets.size(), [&](size_t i) {
+                return e.next_geq(targets[i]).first;
+            });
+
+        stats_line()
+            ("sequence", "compact_ranked_bitvector")
+            ("density", density)
+            ("skip", skip)
+            ("next_geq_ns", ns)
+            ("avx2", bit_scan::has_avx2())
+            ;
+    }
+
+    compact_ranked_bitvector::enumerator e(bv, 0, universe, seq.size(), params);
+    e.move(0);
+    double ns = time_ns_per_call(seq.size() - 1, [&](size_t) {
+            return e.next().second;
+        });
+
+    stats_line()
+        ("sequence", "compact_ranked_bitvector")
+        ("density", density)
+        ("next_ns", ns)
+        ;
+}
+
+int main(int argc, const char** argv)
+{
+    uint64_t universe = 1 << 24;
+    if (argc > 1) {
+        universe = boost::lexical_cast<uint64_t>(argv[1]);
+    }
+
+    std::mt19937_64 rng(42);
+    for (double density: {0.5, 0.125, 0.03125}) {
+        auto seq = random_bits_sequence(universe, density, rng);
+        logger() << "Density " << density << ", "
+                 << seq.size() << " elements" << std::endl;
+
+        succinct::bit_vector_builder bvb(universe);
+        for (auto v: seq) bvb.set(v, 1);
+        succinct::bit_vector bv(&bvb);
+
+        perftest_kernels(bv, density, rng);
+        perftest_next_geq(seq, universe, density);
+    }
+}
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+
+#include "compact_elias_fano.hpp"
+#include "strict_elias_fano.hpp"
+#include "compact_ranked_bitvector.hpp"
+#include "indexed_sequence.hpp"
+#include "partitioned_sequence.hpp"
+#include "uniform_partitioned_sequence.hpp"
+#include "block_codecs.hpp"
+#include "util.hpp"
+
+using namespace quasi_succinct;
+
+// Microbenchmarks of the sequences and of the block codecs on synthetic
+// sequences, one stats_line per measure, to be compared across versions.
+// Each measure is repeated and the fastest repetition is reported, as the
+// slower ones are noise of the machine, not of the code.
+
+struct sequence_params {
+    uint64_t n;
+    double density;    // n / universe
+    double clustering; // probability that a value follows the previous one
+};
+
+// Strictly increasing sequence with the given density on average. With
+// clustering c each gap is 1 with probability c and otherwise geometric,
+// so that the values come in runs of average length 1 / (1 - c)
+std::vector<uint64_t> synthetic_sequence(sequence_params const& p,
+                                         std::mt19937_64& rng)
+{
+    double mean_gap = 1 / p.density;
+    double sparse_gap = (mean_gap - 1) / (1 - p.clustering);
+    std::bernoulli_distribution clustered(p.clustering);
+    std::geometric_distribution<uint64_t> gap(1 / (1 + sparse_gap));
+    std::vector<uint64_t> seq;
+    seq.reserve(p.n);
+    uint64_t v = 0;
+    for (uint64_t i = 0; i < p.n; ++i) {
+        v += clustered(rng) ? 1 : 1 + gap(rng);
+        seq.push_back(v);
+    }
+    return seq;
+}
+
+static const size_t repetitions = 5;
+
+template <typename Functor>
+double best_ns_per_op(size_t ops, Functor f)
+{
+    double best = std::numeric_limits<double>::max();
+    for (size_t r = 0; r < repetitions; ++r) {
+        auto tick = get_time_usecs();
+        uint64_t checksum = f();
+        do_not_optimize_away(checksum);
+        best = std::min(best, (get_time_usecs() - tick) * 1000 / ops);
+    }
+    return best;
+}
+
+void emit(std::string const& name, sequence_params const& p,
+          std::string const& op, double ns, uint64_t skip = 0)
+{
+    stats_line line;
+    line
+        ("sequence", name)
+        ("n", p.n)
+        ("density", p.density)
+        ("clustering", p.clustering)
+        ("op", op)
+        ;
+    if (skip) line("skip", skip);
+    line("ns", ns);
+}
+
+template <typename Enumerator>
+void perftest_next_geq(Enumerator const& proto, std::vector<uint64_t> const& seq,
+                       std::string const& name, sequence_params const& p,
+                       std::true_type /* has_next_geq */)
+{
+    for (uint64_t skip: {1, 4, 16, 64, 256, 4096}) {
+        // the targets are the values skip positions apart
+        std::vector<uint64_t> targets;
+        for (uint64_t i = skip; i < seq.size(); i += skip) {
+            targets.push_back(seq[i]);
+        }
+        if (targets.empty()) continue;
+        double ns = best_ns_per_op(targets.size(), [&] {
+                Enumerator e(proto);
+                e.move(0);
+                uint64_t sum = 0;
+                for (auto t: targets) sum += e.next_geq(t).first;
+                return sum;
+            });
+        emit(name, p, "next_geq", ns, skip);
+    }
+}
+
+template <typename Enumerator>
+void perftest_next_geq(Enumerator const&, std::vector<uint64_t> const&,
+                       std::string const&, sequence_params const&,
+                       std::false_type)
+{}
+
+template <typename Sequence, bool HasNextGeq = true>
+void perftest_sequence(std::vector<uint64_t> const& seq, std::string const& name,
+                       sequence_params const& p, std::mt19937_64& rng)
+{
+    global_parameters params;
+    uint64_t universe = seq.back() + 1;
+
+    succinct::bit_vector_builder bvb;
+    double encode_ns = best_ns_per_op(seq.size(), [&] {
+            succinct::bit_vector_builder b;
+            Sequence::write(b, seq.begin(), universe, seq.size(), params);
+            uint64_t size = b.size();
+            bvb.swap(b);
+            return size;
+        });
+    succinct::bit_vector bv(&bvb);
+    emit(name, p, "encode", encode_ns);
+
+    stats_line()
+        ("sequence", name)
+        ("n", p.n)
+        ("density", p.density)
+        ("clustering", p.clustering)
+        ("bits_per_element", double(bv.size()) / seq.size())
+        ;
+
+    typedef typename Sequence::enumerator enumerator_type;
+    enumerator_type proto(bv, 0, universe, seq.size(), params);
+
+    emit(name, p, "next", best_ns_per_op(seq.size() - 1, [&] {
+                enumerator_type e(proto);
+                e.move(0);
+                uint64_t sum = 0;
+                for (size_t i = 1; i < seq.size(); ++i) sum += e.next().second;
+                return sum;
+            }));
+
+    std::vector<uint64_t> positions(std::min(seq.size(), size_t(1) << 20));
+    std::uniform_int_distribution<uint64_t> dist(0, seq.size() - 1);
+    for (auto& pos: positions) pos = dist(rng);
+    emit(name, p, "move", best_ns_per_op(positions.size(), [&] {
+                enumerator_type e(proto);
+                uint64_t sum = 0;
+                for (auto pos: positions) sum += e.move(pos).second;
+                return sum;
+            }));
+
+    perftest_next_geq(proto, seq, name, p, std::integral_constant<bool, HasNextGeq>());
+}
+
+template <typename BlockCodec>
+void perftest_block_codec(std::vector<uint64_t> const& seq, std::string const& name,
+                          sequence_params const& p)
+{
+    // the blocks of d-gaps minus one, as in the block indexes
+    static const uint64_t block_size = BlockCodec::block_size;
+    size_t n = seq.size() - seq.size() % block_size;
+    if (!n) return;
+    std::vector<uint32_t> gaps(n);
+    for (size_t i = 0; i < n; ++i) {
+        gaps[i] = uint32_t(seq[i] - (i ? seq[i - 1] : 0) - 1);
+    }
+
+    std::vector<uint8_t> encoded;
+    double encode_ns = best_ns_per_op(n, [&] {
+            encoded.clear();
+            for (size_t b = 0; b < n; b += block_size) {
+                BlockCodec::encode(gaps.data() + b, uint32_t(-1), block_size, encoded);
+            }
+            return encoded.size();
+        });
+    emit(name, p, "encode", encode_ns);
+
+    std::vector<uint32_t> decoded(n);
+    double decode_ns = best_ns_per_op(n, [&] {
+            uint8_t const* ptr = encoded.data();
+            for (size_t b = 0; b < n; b += block_size) {
+                ptr = BlockCodec::decode(ptr, decoded.data() + b, uint32_t(-1), block_size);
+            }
+            return uint64_t(decoded[n - 1]);
+        });
+    if (decoded != gaps) {
+        throw std::logic_error(name + " decoded a different sequence");
+    }
+    emit(name, p, "decode", decode_ns);
+
+    stats_line()
+        ("sequence", name)
+        ("n", p.n)
+        ("density", p.density)
+        ("clustering", p.clustering)
+        ("bits_per_element", 8.0 * encoded.size() / n)
+        ;
+}
+
+int main(int argc, const char** argv)
+{
+    uint64_t n = 1 << 20;
+    if (argc > 1) {
+        n = boost::lexical_cast<uint64_t>(argv[1]);
+    }
+
+    std::mt19937_64 rng(42);
+    for (double density: {0.5, 0.05, 0.005}) {
+        for (double clustering: {0.0, 0.9}) {
+            sequence_params p {n, density, clustering};
+            auto seq = synthetic_sequence(p, rng);
+            logger() << "Density " << density << ", clustering " << clustering
+                     << ", " << n << " elements" << std::endl;
+
+            perftest_sequence<compact_elias_fano>(seq, "compact_elias_fano", p, rng);
+            perftest_sequence<strict_elias_fano, false>(seq, "strict_elias_fano", p, rng);
+            perftest_sequence<compact_ranked_bitvector>(seq, "compact_ranked_bitvector", p, rng);
+            perftest_sequence<indexed_sequence>(seq, "indexed_sequence", p, rng);
+            perftest_sequence<uniform_partitioned_sequence<>>(seq, "uniform_partitioned_sequence", p, rng);
+            perftest_sequence<partitioned_sequence<>>(seq, "partitioned_sequence", p, rng);
+
+            perftest_block_codec<optpfor_block>(seq, "optpfor_block", p);
+            perftest_block_codec<varint_G8IU_block>(seq, "varint_G8IU_block", p);
+            perftest_block_codec<interpolative_block>(seq, "interpolative_block", p);
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "global_parameters.hpp"
+#include "sequence_header.hpp"
 #include "strict_sequence.hpp"
 #include "util.hpp"
 
@@ -30,6 +31,27 @@ namespace quasi_succinct {
 
         }
 
+        // the base sequence stores the prefix sums, so merging is merging
+        // the prefix sums with those of b shifted by the sum of a
+        static void write_merged(succinct::bit_vector_builder& bvb,
+                                 encoded_sequence const& a,
+                                 encoded_sequence const& b,
+                                 uint64_t shift, uint64_t universe,
+                                 global_parameters const& params)
+        {
+            base_sequence_type::write_merged(bvb, a, b, shift, universe, params);
+        }
+
+        typedef typename sequence_header<base_sequence_type>::type header_type;
+
+        static void read_header(succinct::bit_vector const& bv, uint64_t offset,
+                                uint64_t universe, uint64_t n,
+                                global_parameters const& params,
+                                header_type& header)
+        {
+            sequence_header<base_sequence_type>::read(bv, offset, universe, n, params, header);
+        }
+
         class enumerator {
         public:
 
@@ -45,6 +67,15 @@ namespace quasi_succinct {
                 , m_position(m_base_enum.size())
             {}
 
+            enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                       uint64_t universe, uint64_t n,
+                       global_parameters const& params,
+                       header_type const& header)
+                : m_base_enum(sequence_header<base_sequence_type>::enumerator
+                              (bv, offset, universe, n, params, header))
+                , m_position(m_base_enum.size())
+            {}
+
             value_type move(uint64_t position)
             {
                 // we cache m_position and m_cur to avoid the call overhead in
@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "configuration.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Drop-in replacement for binary_collection that reads the file with
+    // pread in a dedicated I/O thread instead of relying on page faults on
+    // a memory map. The file is read in aligned chunks of prefetch_chunk
+    // bytes, at most prefetch_ahead chunks ahead of the consumer; with
+    // direct_io the chunks bypass the page cache (O_DIRECT), which the
+    // aligned buffers and offsets allow.
+    //
+    // The sequences keep their chunk alive, since freq_index::builder reads
+    // them after add_posting_list returns; a chunk buffer is recycled once
+    // all of its sequences are released. A sequence crossing the end of a
+    // chunk is copied in a buffer of its own.
+    class prefetched_collection {
+    public:
+        typedef uint32_t posting_type;
+        typedef shared_buffer_sequence<posting_type> sequence;
+
+        prefetched_collection(const char* filename)
+            : m_filename(filename)
+        {
+            struct stat st;
+            if (stat(filename, &st)) {
+                throw std::runtime_error("Error opening file");
+            }
+            m_data_size = st.st_size / sizeof(posting_type);
+        }
+
+        class iterator;
+
+        iterator begin() const
+        {
+            return iterator(this, 0);
+        }
+
+        iterator end() const
+        {
+            return iterator(this, m_data_size);
+        }
+
+    private:
+
+        static const size_t alignment = 4096;
+
+        struct chunk {
+            uint64_t begin; // position of the first posting in the file
+            uint64_t size;  // in postings
+            posting_type* data;
+        };
+
+        typedef std::shared_ptr<chunk const> chunk_ptr;
+
+        // Aligned chunk buffers, shared by the chunks so that it outlives
+        // the reader if the sequences do
+        class buffer_pool {
+        public:
+            buffer_pool(size_t buffer_bytes)
+                : m_buffer_bytes(buffer_bytes)
+            {}
+
+            ~buffer_pool()
+            {
+                for (auto buf: m_free) {
+                    free(buf);
+                }
+            }
+
+            void* get()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!m_free.empty()) {
+                        void* buf = m_free.back();
+                        m_free.pop_back();
+                        return buf;
+                    }
+                }
+                void* buf;
+                // one more aligned block, as the encoders may read one
+                // posting past the end of a sequence
+                if (posix_memalign(&buf, alignment, m_buffer_bytes + alignment)) {
+                    throw std::bad_alloc();
+                }
+                return buf;
+            }
+
+            void release(void* buf)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_free.push_back(buf);
+            }
+
+        private:
+            size_t m_buffer_bytes;
+            std::mutex m_mutex;
+            std::vector<void*> m_free;
+        };
+
+        class chunk_reader {
+        public:
+            chunk_reader(std::string const& filename, uint64_t data_size)
+                : m_consumed(0)
+                , m_stop(false)
+            {
+                auto const& conf = configuration::get();
+                m_chunk_bytes = std::max(alignment,
+                                         conf.prefetch_chunk / alignment * alignment);
+                m_max_ahead = std::max(uint64_t(1), conf.prefetch_ahead);
+                m_file_bytes = data_size * sizeof(posting_type);
+                m_num_chunks = (m_file_bytes + m_chunk_bytes - 1) / m_chunk_bytes;
+                m_pool = std::make_shared<buffer_pool>(m_chunk_bytes);
+
+                m_fd = -1;
+                if (conf.direct_io) {
+                    m_fd = open(filename.c_str(), O_RDONLY | O_DIRECT);
+                    if (m_fd < 0) {
+                        logger() << "O_DIRECT not supported for " << filename
+                                 << ", using buffered reads" << std::endl;
+                    }
+                }
+                if (m_fd < 0) {
+                    m_fd = open(filename.c_str(), O_RDONLY);
+                    if (m_fd < 0) {
+                        throw std::runtime_error("Error opening file");
+                    }
+                    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                }
+
+                m_thread = std::thread([this] { read_loop(); });
+            }
+
+            ~chunk_reader()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                }
+                m_cond.notify_all();
+                m_thread.join();
+                close(m_fd);
+            }
+
+            // Chunks must be requested in order
+            chunk_ptr get(uint64_t k)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                assert(k == m_consumed);
+                m_cond.wait(lock, [&] {
+                        return m_error || m_ready.count(k);
+                    });
+                if (m_error) {
+                    throw std::runtime_error("Error reading file");
+                }
+                chunk_ptr ret = m_ready[k];
+                m_ready.erase(k);
+                m_consumed = k + 1;
+                lock.unlock();
+                m_cond.notify_all();
+                return ret;
+            }
+
+        private:
+
+            void read_loop()
+            {
+                for (uint64_t k = 0; k < m_num_chunks; ++k) {
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_cond.wait(lock, [&] {
+                                return m_stop || k < m_consumed + m_max_ahead;
+                            });
+                        if (m_stop) return;
+                    }
+
+                    uint64_t offset = k * m_chunk_bytes;
+                    uint64_t bytes = std::min(m_chunk_bytes, m_file_bytes - offset);
+                    void* buf = m_pool->get();
+                    if (!read_fully(buf, offset, bytes)) {
+                        m_pool->release(buf);
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_error = true;
+                        m_cond.notify_all();
+                        return;
+                    }
+
+                    auto pool = m_pool;
+                    chunk_ptr c(new chunk {offset / sizeof(posting_type),
+                                           bytes / sizeof(posting_type),
+                                           (posting_type*)buf},
+                                [pool](chunk const* c) {
+                                    pool->release(c->data);
+                                    delete c;
+                                });
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_ready[k] = c;
+                    }
+                    m_cond.notify_all();
+                }
+            }
+
+            bool read_fully(void* buf, uint64_t offset, uint64_t bytes)
+            {
+                // O_DIRECT needs the length rounded up to the alignment, the
+                // read stops at the end of the file anyway
+                uint64_t to_read = (bytes + alignment - 1) / alignment * alignment;
+                uint64_t done = 0;
+                while (done < bytes) {
+                    ssize_t ret = pread(m_fd, (char*)buf + done, to_read - done, offset + done);
+                    if (ret < 0 && errno == EINTR) continue;
+                    if (ret <= 0) return false;
+                    done += ret;
+                }
+                return true;
+            }
+
+            int m_fd;
+            uint64_t m_file_bytes;
+            uint64_t m_chunk_bytes;
+            uint64_t m_num_chunks;
+            uint64_t m_max_ahead;
+            std::shared_ptr<buffer_pool> m_pool;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::map<uint64_t, chunk_ptr> m_ready;
+            uint64_t m_consumed;
+            bool m_stop;
+            bool m_error = false;
+            std::thread m_thread;
+        };
+
+    public:
+
+        // Single-pass iterator: copies share the reader
+        class iterator : public std::iterator<std::forward_iterator_tag,
+                                              sequence> {
+        public:
+            iterator()
+                : m_collection(nullptr)
+            {}
+
+            value_type const& operator*() const
+            {
+                return m_cur_seq;
+            }
+
+            value_type const* operator->() const
+            {
+                return &m_cur_seq;
+            }
+
+            iterator& operator++()
+            {
+                m_pos = m_next_pos;
+                read();
+                return *this;
+            }
+
+            bool operator==(iterator const& other) const
+            {
+                assert(m_collection == other.m_collection);
+                return m_pos == other.m_pos;
+            }
+
+            bool operator!=(iterator const& other) const
+            {
+                return !(*this == other);
+            }
+
+        private:
+            friend class prefetched_collection;
+
+            struct state {
+                state(prefetched_collection const& coll)
+                    : reader(coll.m_filename, coll.m_data_size)
+                    , next_chunk(0)
+                {}
+
+                chunk_reader reader;
+                chunk_ptr cur_chunk;
+                uint64_t next_chunk;
+            };
+
+            iterator(prefetched_collection const* coll, size_t pos)
+                : m_collection(coll)
+                , m_pos(pos)
+            {
+                if (m_pos < m_collection->m_data_size) {
+                    m_state = std::make_shared<state>(*m_collection);
+                }
+                read();
+            }
+
+            // makes the current chunk contain the given position
+            void seek(uint64_t pos)
+            {
+                chunk_ptr& c = m_state->cur_chunk;
+                while (!c || pos >= c->begin + c->size) {
+                    c.reset();
+                    c = m_state->reader.get(m_state->next_chunk++);
+                }
+                assert(pos >= c->begin);
+            }
+
+            posting_type at(uint64_t pos)
+            {
+                seek(pos);
+                return m_state->cur_chunk->data[pos - m_state->cur_chunk->begin];
+            }
+
+            void read()
+            {
+                assert(m_pos <= m_collection->m_data_size);
+                uint64_t data_size = m_collection->m_data_size;
+                if (m_pos == data_size) {
+                    m_state.reset();
+                    m_cur_seq = sequence();
+                    return;
+                }
+
+                size_t n = 0;
+                size_t pos = m_pos;
+                while (pos < data_size && !(n = at(pos++))); // skip empty seqs
+                // file might be truncated
+                n = std::min(n, size_t(data_size - pos));
+                m_next_pos = pos + n;
+                if (!n) {
+                    m_cur_seq = sequence();
+                    return;
+                }
+
+                seek(pos);
+                chunk_ptr const& c = m_state->cur_chunk;
+                if (pos + n <= c->begin + c->size) {
+                    posting_type const* begin = c->data + (pos - c->begin);
+                    m_cur_seq = sequence(c, begin, begin + n);
+                    return;
+                }
+
+                // the sequence spans several chunks
+                auto buf = std::make_shared<std::vector<posting_type>>(n + 1);
+                uint64_t copied = 0;
+                while (copied < n) {
+                    seek(pos + copied);
+                    uint64_t offset = pos + copied - c->begin;
+                    uint64_t len = std::min(n - copied, c->size - offset);
+                    std::memcpy(buf->data() + copied, c->data + offset,
+                                len * sizeof(posting_type));
+                    copied += len;
+                }
+                m_cur_seq = sequence(buf, buf->data(), buf->data() + n);
+            }
+
+            prefetched_collection const* m_collection;
+            size_t m_pos, m_next_pos;
+            std::shared_ptr<state> m_state;
+            sequence m_cur_seq;
+        };
+
+    private:
+        std::string m_filename;
+        size_t m_data_size;
+    };
+
+    // Same as binary_freq_collection, reading the files with
+    // prefetched_collection
+    class prefetched_freq_collection {
+    public:
+
+        prefetched_freq_collection(const char* basename)
+            : m_docs((std::string(basename) + ".docs").c_str())
+            , m_freqs((std::string(basename) + ".freqs").c_str())
+        {
+            // read directly, to avoid starting the prefetching
+            uint32_t header[2] = {0, 0};
+            std::ifstream docs((std::string(basename) + ".docs").c_str(), std::ios::binary);
+            docs.read((char*)header, sizeof(header));
+            if (header[0] != 1) {
+                throw std::invalid_argument("First sequence should only contain number of documents");
+            }
+            m_num_docs = header[1];
+        }
+
+        class iterator;
+
+        iterator begin() const
+        {
+            auto docs_it = m_docs.begin();
+            return iterator(++docs_it, m_freqs.begin());
+        }
+
+        iterator end() const
+        {
+            return iterator(m_docs.end(), m_freqs.end());
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_num_docs;
+        }
+
+        struct sequence {
+            prefetched_collection::sequence docs;
+            prefetched_collection::sequence freqs;
+        };
+
+        class iterator : public std::iterator<std::forward_iterator_tag,
+                                              sequence> {
+        public:
+            iterator()
+            {}
+
+            value_type const& operator*() const
+            {
+                return m_cur_seq;
+            }
+
+            value_type const* operator->() const
+            {
+                return &m_cur_seq;
+            }
+
+            iterator& operator++()
+            {
+                m_cur_seq.docs = *++m_docs_it;
+                m_cur_seq.freqs = *++m_freqs_it;
+                return *this;
+            }
+
+            bool operator==(iterator const& other) const
+            {
+                return m_docs_it == other.m_docs_it;
+            }
+
+            bool operator!=(iterator const& other) const
+            {
+                return !(*this == other);
+            }
+
+        private:
+            friend class prefetched_freq_collection;
+
+            iterator(prefetched_collection::iterator docs_it,
+                     prefetched_collection::iterator freqs_it)
+                : m_docs_it(docs_it)
+                , m_freqs_it(freqs_it)
+            {
+                m_cur_seq.docs = *m_docs_it;
+                m_cur_seq.freqs = *m_freqs_it;
+            }
+
+            prefetched_collection::iterator m_docs_it;
+            prefetched_collection::iterator m_freqs_it;
+            sequence m_cur_seq;
+        };
+
+    private:
+        prefetched_collection m_docs;
+        prefetched_collection m_freqs;
+        uint64_t m_num_docs;
+    };
+}
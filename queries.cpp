@@ -1,12 +1,66 @@
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <numeric>
 
 #include <succinct/mapper.hpp>
 
 #include "index_types.hpp"
 #include "wand_data.hpp"
 #include "queries.hpp"
+#include "enumerator_cache.hpp"
+#include "decoded_list_cache.hpp"
+#include "perf_counters.hpp"
+#include "latency_histogram.hpp"
+#include "query_counters.hpp"
 #include "util.hpp"
 
+// Shared by all the tests, so that the events are opened only once
+quasi_succinct::perf_counters& query_hw_counters()
+{
+    static quasi_succinct::perf_counters counters;
+    static bool logged = false;
+    if (!logged) {
+        if (!counters.available()) {
+            quasi_succinct::logger() << "Hardware performance counters not available"
+                                     << std::endl;
+        }
+        logged = true;
+    }
+    return counters;
+}
+
+// Per-query dump of the timings, selected with --per-query; the CSV rows
+// go to their own file, so that stdout has only JSON lines
+enum class per_query_format { none, csv, json };
+per_query_format per_query_dump = per_query_format::none;
+std::ofstream per_query_csv;
+
+struct per_query_time {
+    size_t query_id;
+    size_t run;
+    double time;
+    uint64_t results;
+};
+
+// Pearson correlation coefficient of xs and ys, 0 if either is constant
+double correlation(std::vector<double> const& xs, std::vector<double> const& ys)
+{
+    size_t n = xs.size();
+    if (n < 2) return 0;
+    double mx = std::accumulate(xs.begin(), xs.end(), 0.0) / n;
+    double my = std::accumulate(ys.begin(), ys.end(), 0.0) / n;
+    double sxy = 0, sxx = 0, syy = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sxy += (xs[i] - mx) * (ys[i] - my);
+        sxx += (xs[i] - mx) * (xs[i] - mx);
+        syy += (ys[i] - my) * (ys[i] - my);
+    }
+    if (sxx == 0 || syy == 0) return 0;
+    return sxy / std::sqrt(sxx * syy);
+}
+
 template <typename QueryOperator, typename IndexType>
 void op_perftest(IndexType const& index,
                  QueryOperator&& query_op, // XXX!!!
@@ -17,44 +71,201 @@ void op_perftest(IndexType const& index,
 {
     using namespace quasi_succinct;
 
-    std::vector<double> query_times;
+    latency_histogram query_times;
+    query_counters total_counters;
+
+    // number of distinct terms and of postings of each query, computed
+    // outside of the timing, to correlate them with the latencies
+    std::vector<double> query_terms(queries.size());
+    std::vector<double> query_postings(queries.size());
+    term_id_vec terms;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        terms = queries[i];
+        remove_duplicate_terms(terms);
+        query_terms[i] = double(terms.size());
+        for (auto term: terms) {
+            query_postings[i] += double(index[term].size());
+        }
+    }
+    // mean time of each query over the timed runs
+    std::vector<double> mean_times(queries.size());
+
+    // timings to dump, written after the runs so that the formatting and
+    // the I/O do not disturb the queries and the hardware counters
+    std::vector<per_query_time> per_query_times;
+    if (per_query_dump != per_query_format::none) {
+        per_query_times.reserve(queries.size() * runs);
+    }
+
+    // hardware counters over the timed runs, reported per query
+    perf_counters& hw_counters = query_hw_counters();
 
     for (size_t run = 0; run <= runs; ++run) {
-        for (auto const& query: queries) {
+        if (run == 1) hw_counters.start();
+        for (size_t i = 0; i < queries.size(); ++i) {
+#ifdef QS_ENABLE_COUNTERS
+            thread_query_counters().reset();
+#endif
             auto tick = get_time_usecs();
-            uint64_t result = query_op(index, query);
+            uint64_t result = query_op(index, queries[i]);
             do_not_optimize_away(result);
             double elapsed = double(get_time_usecs() - tick);
             if (run != 0) { // first run is not timed
-                query_times.push_back(elapsed);
+                query_times.add(elapsed);
+                mean_times[i] += elapsed / runs;
+                if (per_query_dump != per_query_format::none) {
+                    per_query_times.push_back(per_query_time {i, run, elapsed, result});
+                }
+            }
+#ifdef QS_ENABLE_COUNTERS
+            // per-query report, from the untimed run
+            if (run == 0) {
+                query_counters const& counters = thread_query_counters();
+                total_counters += counters;
+                stats_line line;
+                line
+                    ("type", index_type)
+                    ("query", query_type)
+                    ("query_id", i)
+                    ("results", result)
+                    ;
+                counters.dump(line);
             }
+#endif
         }
     }
+    hw_counters.stop();
 
-    if (false) {
-        for (auto t: query_times) {
-            std::cout << (t / 1000) << std::endl;
+    for (auto const& t: per_query_times) {
+        if (per_query_dump == per_query_format::csv) {
+            per_query_csv << index_type << ',' << query_type << ','
+                          << t.query_id << ',' << t.run << ',' << t.time << ','
+                          << query_terms[t.query_id] << ',' << query_postings[t.query_id] << ','
+                          << t.results << '\n';
+        } else {
+            stats_line()
+                ("type", index_type)
+                ("query", query_type)
+                ("query_id", t.query_id)
+                ("run", t.run)
+                ("time", t.time)
+                ("terms", query_terms[t.query_id])
+                ("postings", query_postings[t.query_id])
+                ("results", t.results)
+                ;
         }
-    } else {
-        std::sort(query_times.begin(), query_times.end());
-        double avg = std::accumulate(query_times.begin(), query_times.end(), double()) / query_times.size();
-        double q50 = query_times[query_times.size() / 2];
-        double q90 = query_times[90 * query_times.size() / 100];
-        double q95 = query_times[95 * query_times.size() / 100];
-        logger() << "---- " << index_type << " " << query_type << std::endl;
-        logger() << "Mean: " << avg << std::endl;
-        logger() << "50% quantile: " << q50 << std::endl;
-        logger() << "90% quantile: " << q90 << std::endl;
-        logger() << "95% quantile: " << q95 << std::endl;
-
-        stats_line()
-            ("type", index_type)
-            ("query", query_type)
-            ("avg", avg)
-            ("q50", q50)
-            ("q90", q90)
-            ("q95", q95)
-            ;
+    }
+
+    double avg = query_times.mean();
+    double q50 = query_times.quantile(0.5);
+    double q90 = query_times.quantile(0.9);
+    double q95 = query_times.quantile(0.95);
+    double q99 = query_times.quantile(0.99);
+    double q999 = query_times.quantile(0.999);
+    double qmax = query_times.max();
+    double corr_terms = correlation(mean_times, query_terms);
+    double corr_postings = correlation(mean_times, query_postings);
+    logger() << "---- " << index_type << " " << query_type << std::endl;
+    logger() << "Mean: " << avg << std::endl;
+    logger() << "50% quantile: " << q50 << std::endl;
+    logger() << "90% quantile: " << q90 << std::endl;
+    logger() << "95% quantile: " << q95 << std::endl;
+    logger() << "99% quantile: " << q99 << std::endl;
+    logger() << "99.9% quantile: " << q999 << std::endl;
+    logger() << "Max: " << qmax << std::endl;
+    logger() << "Correlation with terms: " << corr_terms
+             << ", with postings: " << corr_postings << std::endl;
+
+    stats_line line;
+    line
+        ("type", index_type)
+        ("query", query_type)
+        ("avg", avg)
+        ("q50", q50)
+        ("q90", q90)
+        ("q95", q95)
+        ("q99", q99)
+        ("q999", q999)
+        ("max", qmax)
+        ("corr_terms", corr_terms)
+        ("corr_postings", corr_postings)
+        ;
+    hw_counters.dump(line, query_times.count());
+#ifdef QS_ENABLE_COUNTERS
+    total_counters.dump(line);
+#endif
+}
+
+
+// Times the queries in batches of batch_size and reports the amortized
+// per-query latency
+template <typename QueryOperator, typename IndexType>
+void batch_perftest(IndexType const& index,
+                    QueryOperator&& query_op,
+                    std::vector<quasi_succinct::term_id_vec> const& queries,
+                    std::string const& index_type,
+                    std::string const& query_type,
+                    size_t batch_size,
+                    size_t runs)
+{
+    using namespace quasi_succinct;
+
+    enumerator_cache<IndexType> cache(index);
+    std::vector<term_id_vec> batch;
+    double elapsed = 0;
+    size_t timed_queries = 0;
+
+    for (size_t run = 0; run <= runs; ++run) {
+        cache.clear();
+        for (size_t b = 0; b < queries.size(); b += batch_size) {
+            batch.assign(queries.begin() + b,
+                         queries.begin() + std::min(b + batch_size, queries.size()));
+            auto tick = get_time_usecs();
+            batch_query(cache, query_op, batch,
+                        [](size_t, uint64_t result) {
+                            do_not_optimize_away(result);
+                        });
+            if (run != 0) { // first run is not timed
+                elapsed += get_time_usecs() - tick;
+                timed_queries += batch.size();
+            }
+        }
+    }
+
+    double avg = elapsed / timed_queries;
+    logger() << "---- " << index_type << " " << query_type
+             << " (batches of " << batch_size << ")" << std::endl;
+    logger() << "Amortized mean: " << avg << std::endl;
+
+    stats_line()
+        ("type", index_type)
+        ("query", query_type)
+        ("batch_size", batch_size)
+        ("avg", avg)
+        ("cache_hits", cache.hits())
+        ("cache_misses", cache.misses())
+        ;
+}
+
+
+template <typename IndexType, typename TopkQueue>
+void topk_perftest(IndexType const& index,
+                   quasi_succinct::wand_data<> const& wdata,
+                   std::vector<quasi_succinct::term_id_vec> const& queries,
+                   std::string const& type,
+                   std::string const& queue_type,
+                   quasi_succinct::deleted_docs const* deleted)
+{
+    using namespace quasi_succinct;
+
+    for (uint64_t k: {10, 100, 1000, 10000}) {
+        std::string suffix = "_" + queue_type + "_k" + std::to_string(k);
+        op_perftest(index, basic_ranked_or_query<TopkQueue>(wdata, k, deleted),
+                    queries, type, "ranked_or" + suffix, 1);
+        op_perftest(index, basic_wand_query<TopkQueue>(wdata, k, false, deleted),
+                    queries, type, "wand" + suffix, 1);
+        op_perftest(index, basic_maxscore_query<TopkQueue>(wdata, k, false, deleted),
+                    queries, type, "maxscore" + suffix, 1);
     }
 }
 
@@ -62,6 +273,7 @@ void op_perftest(IndexType const& index,
 template <typename IndexType>
 void perftest(const char* index_filename,
               const char* wand_data_filename,
+              const char* deleted_filename,
               std::vector<quasi_succinct::term_id_vec> const& queries,
               std::string const& type)
 {
@@ -72,20 +284,84 @@ void perftest(const char* index_filename,
     boost::iostreams::mapped_file_source m(index_filename);
     succinct::mapper::map(index, m, succinct::mapper::map_flags::warmup);
 
+    deleted_docs deleted_set;
+    deleted_docs const* deleted = nullptr;
+    boost::iostreams::mapped_file_source mdel;
+    if (deleted_filename) {
+        mdel.open(deleted_filename);
+        succinct::mapper::map(deleted_set, mdel, succinct::mapper::map_flags::warmup);
+        deleted = &deleted_set;
+        logger() << "Skipping " << deleted->num_deleted() << " deleted documents"
+                 << std::endl;
+    }
+
     logger() << "Performing " << type << " queries" << std::endl;
-    op_perftest(index, and_query<false>(), queries, type, "and", 3);
-    op_perftest(index, and_query<true>(), queries, type, "and_freq", 3);
-    op_perftest(index, or_query<false>(), queries, type, "or", 1);
-    op_perftest(index, or_query<true>(), queries, type, "or_freq", 1);
+    // cost of operator[] alone, i.e. of setting up the enumerators
+    op_perftest(index, [](IndexType const& index, term_id_vec const& terms) {
+            uint64_t size = 0;
+            for (auto term: terms) {
+                size += index[term].size();
+            }
+            return size;
+        }, queries, type, "lookup", 3);
+    op_perftest(index, and_query<false>(deleted), queries, type, "and", 3);
+    op_perftest(index, and_query<true>(deleted), queries, type, "and_freq", 3);
+    op_perftest(index, bitmap_and_query<false>(deleted), queries, type, "bitmap_and", 3);
+    op_perftest(index, bitmap_and_query<true>(deleted), queries, type, "bitmap_and_freq", 3);
+    op_perftest(index, or_query<false>(deleted), queries, type, "or", 1);
+    op_perftest(index, or_query<true>(deleted), queries, type, "or_freq", 1);
+
+    // the hot lists of the query log decoded once, only if a memory
+    // budget is given
+    std::unique_ptr<decoded_list_cache<IndexType>> decoded;
+    if (configuration::get().decoded_cache_mb) {
+        decoded.reset(new decoded_list_cache<IndexType>(index));
+        decoded->prepare(queries);
+        logger() << "Decoded " << decoded->cached_terms() << " hot terms in "
+                 << (decoded->cached_bytes() >> 20) << "MB" << std::endl;
+        op_perftest(*decoded, and_query<false>(deleted), queries, type, "and_decoded", 3);
+        op_perftest(*decoded, and_query<true>(deleted), queries, type, "and_freq_decoded", 3);
+        op_perftest(*decoded, or_query<false>(deleted), queries, type, "or_decoded", 1);
+    }
+
+    for (size_t batch_size: {16, 256}) {
+        batch_perftest(index, and_query<false>(deleted), queries, type, "and_batch", batch_size, 3);
+        batch_perftest(index, or_query<false>(deleted), queries, type, "or_batch", batch_size, 1);
+    }
 
     if (wand_data_filename) {
         wand_data<> wdata;
         boost::iostreams::mapped_file_source md(wand_data_filename);
         succinct::mapper::map(wdata, md, succinct::mapper::map_flags::warmup);
-        op_perftest(index, ranked_and_query(wdata, 10), queries, type, "ranked_and", 3);
-        op_perftest(index, ranked_or_query(wdata, 10), queries, type, "ranked_or", 1);
-        op_perftest(index, wand_query(wdata, 10), queries, type, "wand", 1);
-        op_perftest(index, maxscore_query(wdata, 10), queries, type, "maxscore", 1);
+        if (wdata.norm_len_bits()) {
+            logger() << "Norm lens quantized to " << wdata.norm_len_bits() << " bits" << std::endl;
+        }
+        op_perftest(index, ranked_and_query(wdata, 10, deleted), queries, type, "ranked_and", 3);
+        op_perftest(index, ranked_or_query(wdata, 10, deleted), queries, type, "ranked_or", 1);
+        op_perftest(index, wand_query(wdata, 10, false, deleted), queries, type, "wand", 1);
+        op_perftest(index, maxscore_query(wdata, 10, false, deleted), queries, type, "maxscore", 1);
+
+        // threshold priming from the single-term k-th weights
+        op_perftest(index, wand_query(wdata, 10, true, deleted), queries, type, "wand_primed", 1);
+        op_perftest(index, maxscore_query(wdata, 10, true, deleted), queries, type, "maxscore_primed", 1);
+        if (decoded) {
+            op_perftest(*decoded, ranked_and_query(wdata, 10, deleted), queries, type, "ranked_and_decoded", 3);
+            op_perftest(*decoded, wand_query(wdata, 10, false, deleted), queries, type, "wand_decoded", 1);
+            op_perftest(*decoded, maxscore_query(wdata, 10, false, deleted), queries, type, "maxscore_decoded", 1);
+        }
+        op_perftest(index, wand_query(wdata, 1000, false, deleted), queries, type, "wand_k1000", 1);
+        op_perftest(index, wand_query(wdata, 1000, true, deleted), queries, type, "wand_primed_k1000", 1);
+        op_perftest(index, maxscore_query(wdata, 1000, false, deleted), queries, type, "maxscore_k1000", 1);
+        op_perftest(index, maxscore_query(wdata, 1000, true, deleted), queries, type, "maxscore_primed_k1000", 1);
+
+        // heap versus buffered top-k queue across k
+        topk_perftest<IndexType, topk_queue>(index, wdata, queries, type, "heap", deleted);
+        topk_perftest<IndexType, buffered_topk_queue>(index, wdata, queries, type, "buffered", deleted);
+
+        for (size_t batch_size: {16, 256}) {
+            batch_perftest(index, wand_query(wdata, 10, false, deleted), queries, type, "wand_batch", batch_size, 1);
+            batch_perftest(index, maxscore_query(wdata, 10, false, deleted), queries, type, "maxscore_batch", batch_size, 1);
+        }
     }
 
 }
@@ -94,11 +370,57 @@ int main(int argc, const char** argv)
 {
     using namespace quasi_succinct;
 
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <index filename> [<wand data filename>]"
+                  << " [--deleted <deleted docs filename>]"
+                  << " [--per-query json|csv <filename>] < queries" << std::endl;
+        return 1;
+    }
+
     std::string type = argv[1];
     const char* index_filename = argv[2];
     const char* wand_data_filename = nullptr;
-    if (argc >= 4) {
-        wand_data_filename = argv[3];
+    const char* deleted_filename = nullptr;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool is_option = arg.compare(0, 2, "--") == 0;
+        if (is_option && i + 1 == argc) {
+            logger() << "ERROR: Missing value for option " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--deleted") {
+            deleted_filename = argv[++i];
+        } else if (arg == "--per-query") {
+            std::string format = argv[++i];
+            if (format == "csv") {
+                if (i + 1 == argc) {
+                    logger() << "ERROR: --per-query csv needs a filename" << std::endl;
+                    return 1;
+                }
+                per_query_dump = per_query_format::csv;
+                per_query_csv.open(argv[++i]);
+                if (!per_query_csv) {
+                    logger() << "ERROR: Cannot open " << argv[i] << std::endl;
+                    return 1;
+                }
+                per_query_csv << "type,query,query_id,run,time,terms,postings,results" << std::endl;
+            } else if (format == "json") {
+                per_query_dump = per_query_format::json;
+            } else {
+                logger() << "ERROR: Unknown per-query format " << format << std::endl;
+                return 1;
+            }
+        } else if (is_option) {
+            logger() << "ERROR: Unknown option " << arg << std::endl;
+            return 1;
+        } else if (!wand_data_filename) {
+            // the only positional argument after the index
+            wand_data_filename = argv[i];
+        } else {
+            logger() << "ERROR: Unexpected argument " << arg << std::endl;
+            return 1;
+        }
     }
 
     std::vector<term_id_vec> queries;
@@ -106,16 +428,18 @@ int main(int argc, const char** argv)
     while (read_query(q)) queries.push_back(q);
 
     if (false) {
-#define LOOP_BODY(R, DATA, T)                                   \
-        } else if (type == BOOST_PP_STRINGIZE(T)) {             \
-            perftest<BOOST_PP_CAT(T, _index)>                   \
-                (index_filename, wand_data_filename, queries, type); \
+#define LOOP_BODY(R, DATA, T)                                           \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {                     \
+            perftest<BOOST_PP_CAT(T, _index)>                           \
+                (index_filename, wand_data_filename, deleted_filename,  \
+                 queries, type);                                        \
             /**/
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
 #undef LOOP_BODY
     } else {
         logger() << "ERROR: Unknown type " << type << std::endl;
+        return 1;
     }
 
 }
@@ -2,9 +2,15 @@
 
 #include <iostream>
 #include <sstream>
+#include <utility>
 
+#include <succinct/broadword.hpp>
+
+#include "bit_scan.hpp"
 #include "index_types.hpp"
 #include "wand_data.hpp"
+#include "deleted_docs.hpp"
+#include "query_counters.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -32,9 +38,17 @@ namespace quasi_succinct {
         terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
     }
 
+    // All the operators take an optional set of deleted docids, which are
+    // checked only once a document is known to match (AND) or to be worth
+    // scoring (WAND, MaxScore), so that the lists are traversed as without
+    // deletions and the upper bounds used for pruning remain valid.
     template <bool with_freqs>
     struct and_query {
 
+        explicit and_query(deleted_docs const* deleted = nullptr)
+            : m_deleted(deleted)
+        {}
+
         template <typename Index>
         uint64_t operator()(Index const& index, term_id_vec terms) const
         {
@@ -69,10 +83,12 @@ namespace quasi_succinct {
                 }
 
                 if (i == enums.size()) {
-                    results += 1;
-                    if (with_freqs) {
-                        for (i = 0; i < enums.size(); ++i) {
-                            do_not_optimize_away(enums[i].freq());
+                    if (!is_deleted(m_deleted, candidate)) {
+                        results += 1;
+                        if (with_freqs) {
+                            for (i = 0; i < enums.size(); ++i) {
+                                do_not_optimize_away(enums[i].freq());
+                            }
                         }
                     }
                     enums[0].next();
@@ -83,11 +99,214 @@ namespace quasi_succinct {
 
             return results;
         }
+
+    private:
+        deleted_docs const* m_deleted;
+    };
+
+    // Raw bitmap of the ranked-bitvector partition containing the current
+    // docid of a document enumerator, for indexes whose docs sequences
+    // expose a partition_view (see partitioned_sequence)
+    struct bitmap_range {
+        succinct::bit_vector const* bv;
+        uint64_t offset; // position in bv of the bit of docid base
+        uint64_t base;
+        uint64_t upper_bound;
+    };
+
+    // partitioned_sequence::enumerator::partition() is declared for any
+    // base sequence but compiles only for indexed_sequence, so the type of
+    // the view is checked too
+    template <typename Enum>
+    struct has_partition_view
+    {
+        template <typename U>
+        static char test(typename std::enable_if<
+                             std::is_same<decltype(std::declval<U const&>()
+                                                   .docs_enum().partition().type),
+                                          indexed_sequence::index_type>::value
+                             >::type*);
+        template <typename U> static int test(...);
+        enum { value = sizeof(test<Enum>(0)) == sizeof(char) };
+    };
+
+    template <typename Enum, bool = has_partition_view<Enum>::value>
+    struct partition_bitmap {
+        static bool get(Enum const&, bitmap_range&)
+        {
+            return false;
+        }
+    };
+
+    template <typename Enum>
+    struct partition_bitmap<Enum, true> {
+        static bool get(Enum const& e, bitmap_range& range)
+        {
+            auto view = e.docs_enum().partition();
+            if (view.type != indexed_sequence::ranked_bitvector) return false;
+            range.bv = view.bv;
+            range.offset = view.bitmap_offset;
+            range.base = view.base;
+            range.upper_bound = view.upper_bound;
+            return true;
+        }
+    };
+
+    // Calls f(docid) for each docid in [lo, hi] set in both bitmaps, which
+    // must cover the range. The bitmaps are ANDed 256 bits at a time, with
+    // AVX2 where the CPU supports it (see bit_scan::and_256).
+    template <typename Functor>
+    void intersect_bitmaps(bitmap_range const& a, bitmap_range const& b,
+                           uint64_t lo, uint64_t hi, Functor&& f)
+    {
+        assert(lo >= a.base && hi <= a.upper_bound);
+        assert(lo >= b.base && hi <= b.upper_bound);
+        uint64_t a_offset = a.offset + (lo - a.base);
+        uint64_t b_offset = b.offset + (lo - b.base);
+        uint64_t len = hi - lo + 1;
+        uint64_t const* a_data = a.bv->data().data();
+        uint64_t const* b_data = b.bv->data().data();
+        uint64_t a_size = a.bv->data().size();
+        uint64_t b_size = b.bv->data().size();
+
+        for (uint64_t block = 0; block < len; block += 256) {
+            uint64_t words[4];
+            // and_256 reads the 5 words from the one containing the
+            // first bit; the last block and the blocks at the end of the
+            // bit vectors are read with get_word
+            if (len - block >= 256 &&
+                (a_offset + block) / 64 + 5 <= a_size &&
+                (b_offset + block) / 64 + 5 <= b_size) {
+                bit_scan::and_256(a_data, a_offset + block,
+                                  b_data, b_offset + block, words);
+            } else {
+                for (size_t w = 0; w < 4; ++w) {
+                    uint64_t pos = block + w * 64;
+                    if (pos < len) {
+                        uint64_t mask = (len - pos >= 64)
+                            ? uint64_t(-1)
+                            : ((uint64_t(1) << (len - pos)) - 1);
+                        words[w] = a.bv->get_word(a_offset + pos) & mask
+                            & b.bv->get_word(b_offset + pos);
+                    } else {
+                        words[w] = 0;
+                    }
+                }
+            }
+
+            for (size_t w = 0; w < 4; ++w) {
+                uint64_t word = words[w];
+                while (word) {
+                    f(lo + block + w * 64 + succinct::broadword::lsb(word));
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    // Same results as and_query, but when the two shortest lists are both
+    // in ranked-bitvector partitions the overlapping docid range is
+    // intersected word-wise instead of one next_geq at a time. Falls back
+    // to and_query's leapfrogging elsewhere and on indexes without
+    // partition views.
+    template <bool with_freqs>
+    struct bitmap_and_query {
+
+        explicit bitmap_and_query(deleted_docs const* deleted = nullptr)
+            : m_deleted(deleted)
+        {}
+
+        template <typename Index>
+        uint64_t operator()(Index const& index, term_id_vec terms) const
+        {
+            if (terms.empty()) return 0;
+            remove_duplicate_terms(terms);
+            if (terms.size() == 1) return and_query<with_freqs>(m_deleted)(index, terms);
+
+            typedef typename Index::document_enumerator enum_type;
+            std::vector<enum_type> enums;
+            enums.reserve(terms.size());
+
+            for (auto term: terms) {
+                enums.push_back(index[term]);
+            }
+
+            // sort by increasing frequency
+            std::sort(enums.begin(), enums.end(),
+                      [](enum_type const& lhs, enum_type const& rhs) {
+                          return lhs.size() < rhs.size();
+                      });
+
+            uint64_t results = 0;
+            uint64_t num_docs = index.num_docs();
+            uint64_t candidate = enums[0].docid();
+            bitmap_range r0, r1;
+            while (candidate < num_docs) {
+                if (enums[1].docid() < candidate) enums[1].next_geq(candidate);
+
+                if (partition_bitmap<enum_type>::get(enums[0], r0) &&
+                    partition_bitmap<enum_type>::get(enums[1], r1)) {
+                    // no docid of enums[1] lies in [candidate, r1.base)
+                    uint64_t lo = std::max(candidate, r1.base);
+                    uint64_t hi = std::min(r0.upper_bound, r1.upper_bound);
+                    if (lo <= hi) {
+                        intersect_bitmaps(r0, r1, lo, hi, [&](uint64_t docid) {
+                                for (size_t i = 2; i < enums.size(); ++i) {
+                                    if (enums[i].docid() < docid) enums[i].next_geq(docid);
+                                    if (enums[i].docid() != docid) return;
+                                }
+                                if (is_deleted(m_deleted, docid)) return;
+                                results += 1;
+                                if (with_freqs) {
+                                    enums[0].next_geq(docid);
+                                    enums[1].next_geq(docid);
+                                    for (size_t i = 0; i < enums.size(); ++i) {
+                                        do_not_optimize_away(enums[i].freq());
+                                    }
+                                }
+                            });
+                        enums[0].next_geq(hi + 1);
+                        candidate = enums[0].docid();
+                        continue;
+                    }
+                }
+
+                size_t i = 1;
+                for (; i < enums.size(); ++i) {
+                    if (enums[i].docid() < candidate) enums[i].next_geq(candidate);
+                    if (enums[i].docid() != candidate) break;
+                }
+
+                if (i == enums.size()) {
+                    if (!is_deleted(m_deleted, candidate)) {
+                        results += 1;
+                        if (with_freqs) {
+                            for (i = 0; i < enums.size(); ++i) {
+                                do_not_optimize_away(enums[i].freq());
+                            }
+                        }
+                    }
+                    enums[0].next();
+                } else {
+                    enums[0].next_geq(enums[i].docid());
+                }
+                candidate = enums[0].docid();
+            }
+
+            return results;
+        }
+
+    private:
+        deleted_docs const* m_deleted;
     };
 
     template <bool with_freqs>
     struct or_query {
 
+        explicit or_query(deleted_docs const* deleted = nullptr)
+            : m_deleted(deleted)
+        {}
+
         template <typename Index>
         uint64_t operator()(Index const& index, term_id_vec terms) const
         {
@@ -109,11 +328,12 @@ namespace quasi_succinct {
                                                 })->docid();
 
             while (cur_doc < index.num_docs()) {
-                results += 1;
+                bool deleted = is_deleted(m_deleted, cur_doc);
+                results += !deleted;
                 uint64_t next_doc = index.num_docs();
                 for (size_t i = 0; i < enums.size(); ++i) {
                     if (enums[i].docid() == cur_doc) {
-                        if (with_freqs) {
+                        if (with_freqs && !deleted) {
                             do_not_optimize_away(enums[i].freq());
                         }
                         enums[i].next();
@@ -128,6 +348,9 @@ namespace quasi_succinct {
 
             return results;
         }
+
+    private:
+        deleted_docs const* m_deleted;
     };
 
     typedef std::pair<uint64_t, uint64_t> term_freq_pair;
@@ -152,11 +375,15 @@ namespace quasi_succinct {
     struct topk_queue {
         topk_queue(uint64_t k)
             : m_k(k)
+            , m_threshold(0)
         {}
 
         bool insert(float score)
         {
             if (m_q.size() < m_k) {
+                if (score < m_threshold) {
+                    return false;
+                }
                 m_q.push_back(score);
                 std::push_heap(m_q.begin(), m_q.end(), std::greater<float>());
                 return true;
@@ -173,7 +400,19 @@ namespace quasi_succinct {
 
         bool would_enter(float score) const
         {
-            return m_q.size() < m_k || score > m_q.front();
+            if (m_q.size() < m_k) {
+                return score >= m_threshold;
+            }
+            return score > m_q.front();
+        }
+
+        // Sets a lower bound on the final k-th score: until the queue is
+        // full, scores below it are rejected. It must be safe, i.e. at least
+        // k documents must score at least threshold, otherwise the queue
+        // ends up with fewer than k results.
+        void set_threshold(float threshold)
+        {
+            m_threshold = threshold;
         }
 
         void finalize()
@@ -186,24 +425,138 @@ namespace quasi_succinct {
             return m_q;
         }
 
+        uint64_t k() const
+        {
+            return m_k;
+        }
+
+        void clear()
+        {
+            m_q.clear();
+            m_threshold = 0;
+        }
+
+    private:
+        uint64_t m_k;
+        float m_threshold;
+        std::vector<float> m_q;
+    };
+
+    // Same contract as topk_queue, but instead of maintaining a heap it
+    // appends the scores above the current threshold to a buffer of 2k
+    // entries; when the buffer is full, nth_element keeps the top k and the
+    // threshold is raised to the k-th score. Insertion is amortized O(1),
+    // which pays off for large k; the price is a threshold that lags behind
+    // the heap's, so would_enter() prunes a bit less between compactions.
+    struct buffered_topk_queue {
+        buffered_topk_queue(uint64_t k)
+            : m_k(k)
+            , m_threshold(0)
+        {
+            m_q.reserve(2 * m_k);
+        }
+
+        bool insert(float score)
+        {
+            if (m_q.size() < m_k) {
+                if (score < m_threshold) {
+                    return false;
+                }
+                m_q.push_back(score);
+                if (m_q.size() == m_k) {
+                    m_threshold = *std::min_element(m_q.begin(), m_q.end());
+                }
+                return true;
+            }
+
+            if (score > m_threshold) {
+                m_q.push_back(score);
+                if (m_q.size() == 2 * m_k) {
+                    compact();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        bool would_enter(float score) const
+        {
+            if (m_q.size() < m_k) {
+                return score >= m_threshold;
+            }
+            return score > m_threshold;
+        }
+
+        void set_threshold(float threshold)
+        {
+            m_threshold = threshold;
+        }
+
+        void finalize()
+        {
+            if (m_q.size() > m_k) {
+                compact();
+            }
+            std::sort(m_q.begin(), m_q.end(), std::greater<float>());
+        }
+
+        std::vector<float> const& topk() const
+        {
+            return m_q;
+        }
+
+        uint64_t k() const
+        {
+            return m_k;
+        }
+
         void clear()
         {
             m_q.clear();
+            m_threshold = 0;
         }
 
     private:
+
+        void compact()
+        {
+            std::nth_element(m_q.begin(), m_q.begin() + (m_k - 1), m_q.end(),
+                             std::greater<float>());
+            m_q.resize(m_k);
+            m_threshold = m_q.back();
+        }
+
         uint64_t m_k;
+        float m_threshold;
         std::vector<float> m_q;
     };
 
+    // Lower bound on the k-th highest score of a disjunctive query: a term
+    // alone gives each of its documents at least q_weight times its
+    // doc_term_weight, and scores are sums of non-negative weights. With
+    // deletions, k + num_deleted postings are needed for k to survive.
+    template <typename Scorer>
+    float single_term_threshold(wand_data<Scorer> const& wdata,
+                                uint64_t term_id, float q_weight, uint64_t k,
+                                deleted_docs const* deleted = nullptr)
+    {
+        if (deleted) k += deleted->num_deleted();
+        return q_weight * wdata.kth_term_weight(term_id, k);
+    }
 
-    struct wand_query {
+
+    template <typename TopkQueue>
+    struct basic_wand_query {
 
         typedef bm25 scorer_type;
 
-        wand_query(wand_data<scorer_type> const& wdata, uint64_t k)
+        basic_wand_query(wand_data<scorer_type> const& wdata, uint64_t k,
+                         bool prime_threshold = false,
+                         deleted_docs const* deleted = nullptr)
             : m_wdata(wdata)
             , m_topk(k)
+            , m_prime_threshold(prime_threshold)
+            , m_deleted(deleted)
         {}
 
         template <typename Index>
@@ -225,13 +578,21 @@ namespace quasi_succinct {
             std::vector<scored_enum> enums;
             enums.reserve(query_term_freqs.size());
 
+            float threshold = 0;
             for (auto term: query_term_freqs) {
                 auto list = index[term.first];
                 auto q_weight = scorer_type::query_term_weight
                     (term.second, list.size(), num_docs);
                 auto max_weight = q_weight * m_wdata.max_term_weight(term.first);
                 enums.push_back(scored_enum {std::move(list), q_weight, max_weight});
+                if (m_prime_threshold) {
+                    threshold = std::max(threshold,
+                                         single_term_threshold(m_wdata, term.first,
+                                                               q_weight, m_topk.k(),
+                                                               m_deleted));
+                }
             }
+            m_topk.set_threshold(threshold);
 
             std::vector<scored_enum*> ordered_enums;
             ordered_enums.reserve(enums.size());
@@ -272,22 +633,30 @@ namespace quasi_succinct {
                 // check if pivot is a possible match
                 uint64_t pivot_id = ordered_enums[pivot]->docs_enum.docid();
                 if (pivot_id == ordered_enums[0]->docs_enum.docid()) {
+                    // a deleted pivot is skipped as if it did not enter
+                    bool deleted = is_deleted(m_deleted, pivot_id);
                     float score = 0;
-                    float norm_len = m_wdata.norm_len(pivot_id);
+                    float len_factor = m_wdata.len_factor(pivot_id);
                     for (scored_enum* en: ordered_enums) {
                         if (en->docs_enum.docid() != pivot_id) {
                             break;
                         }
-                        score += en->q_weight * scorer_type::doc_term_weight
-                            (en->docs_enum.freq(), norm_len);
+                        if (!deleted) {
+                            score += en->q_weight * scorer_type::doc_term_weight_from_factor
+                                (en->docs_enum.freq(), len_factor);
+                        }
                         en->docs_enum.next();
                     }
 
-                    m_topk.insert(score);
+                    if (!deleted) {
+                        QS_COUNT(scored_docs);
+                        m_topk.insert(score);
+                    }
                     // resort by docid
                     sort_enums();
                 } else {
                     // no match, move farthest list up to the pivot
+                    QS_COUNT(pruned_docs);
                     uint64_t next_list = pivot;
                     for (; ordered_enums[next_list]->docs_enum.docid() == pivot_id;
                          --next_list);
@@ -315,17 +684,24 @@ namespace quasi_succinct {
 
     private:
         wand_data<scorer_type> const& m_wdata;
-        topk_queue m_topk;
+        TopkQueue m_topk;
+        bool m_prime_threshold;
+        deleted_docs const* m_deleted;
     };
 
+    typedef basic_wand_query<topk_queue> wand_query;
 
-    struct ranked_and_query {
+
+    template <typename TopkQueue>
+    struct basic_ranked_and_query {
 
         typedef bm25 scorer_type;
 
-        ranked_and_query(wand_data<scorer_type> const& wdata, uint64_t k)
+        basic_ranked_and_query(wand_data<scorer_type> const& wdata, uint64_t k,
+                               deleted_docs const* deleted = nullptr)
             : m_wdata(wdata)
             , m_topk(k)
+            , m_deleted(deleted)
         {}
 
         template <typename Index>
@@ -372,14 +748,17 @@ namespace quasi_succinct {
                 }
 
                 if (i == enums.size()) {
-                    float norm_len = m_wdata.norm_len(candidate);
-                    float score = 0;
-                    for (i = 0; i < enums.size(); ++i) {
-                        score += enums[i].q_weight * scorer_type::doc_term_weight
-                            (enums[i].docs_enum.freq(), norm_len);
-                    }
+                    if (!is_deleted(m_deleted, candidate)) {
+                        float len_factor = m_wdata.len_factor(candidate);
+                        float score = 0;
+                        for (i = 0; i < enums.size(); ++i) {
+                            score += enums[i].q_weight * scorer_type::doc_term_weight_from_factor
+                                (enums[i].docs_enum.freq(), len_factor);
+                        }
 
-                    m_topk.insert(score);
+                        QS_COUNT(scored_docs);
+                        m_topk.insert(score);
+                    }
                     enums[0].docs_enum.next();
                     candidate = enums[0].docs_enum.docid();
                     i = 1;
@@ -397,17 +776,23 @@ namespace quasi_succinct {
 
     private:
         wand_data<scorer_type> const& m_wdata;
-        topk_queue m_topk;
+        TopkQueue m_topk;
+        deleted_docs const* m_deleted;
     };
 
+    typedef basic_ranked_and_query<topk_queue> ranked_and_query;
+
 
-    struct ranked_or_query {
+    template <typename TopkQueue>
+    struct basic_ranked_or_query {
 
         typedef bm25 scorer_type;
 
-        ranked_or_query(wand_data<scorer_type> const& wdata, uint64_t k)
+        basic_ranked_or_query(wand_data<scorer_type> const& wdata, uint64_t k,
+                              deleted_docs const* deleted = nullptr)
             : m_wdata(wdata)
             , m_topk(k)
+            , m_deleted(deleted)
         {}
 
         template <typename Index>
@@ -443,13 +828,16 @@ namespace quasi_succinct {
                 ->docs_enum.docid();
 
             while (cur_doc < index.num_docs()) {
+                bool deleted = is_deleted(m_deleted, cur_doc);
                 float score = 0;
-                float norm_len = m_wdata.norm_len(cur_doc);
+                float len_factor = m_wdata.len_factor(cur_doc);
                 uint64_t next_doc = index.num_docs();
                 for (size_t i = 0; i < enums.size(); ++i) {
                     if (enums[i].docs_enum.docid() == cur_doc) {
-                        score += enums[i].q_weight * scorer_type::doc_term_weight
-                            (enums[i].docs_enum.freq(), norm_len);
+                        if (!deleted) {
+                            score += enums[i].q_weight * scorer_type::doc_term_weight_from_factor
+                                (enums[i].docs_enum.freq(), len_factor);
+                        }
                         enums[i].docs_enum.next();
                     }
                     if (enums[i].docs_enum.docid() < next_doc) {
@@ -457,7 +845,10 @@ namespace quasi_succinct {
                     }
                 }
 
-                m_topk.insert(score);
+                if (!deleted) {
+                    QS_COUNT(scored_docs);
+                    m_topk.insert(score);
+                }
                 cur_doc = next_doc;
             }
 
@@ -472,16 +863,24 @@ namespace quasi_succinct {
 
     private:
         wand_data<scorer_type> const& m_wdata;
-        topk_queue m_topk;
+        TopkQueue m_topk;
+        deleted_docs const* m_deleted;
     };
 
-    struct maxscore_query {
+    typedef basic_ranked_or_query<topk_queue> ranked_or_query;
+
+    template <typename TopkQueue>
+    struct basic_maxscore_query {
 
         typedef bm25 scorer_type;
 
-        maxscore_query(wand_data<scorer_type> const& wdata, uint64_t k)
+        basic_maxscore_query(wand_data<scorer_type> const& wdata, uint64_t k,
+                             bool prime_threshold = false,
+                             deleted_docs const* deleted = nullptr)
             : m_wdata(wdata)
             , m_topk(k)
+            , m_prime_threshold(prime_threshold)
+            , m_deleted(deleted)
         {}
 
         template <typename Index>
@@ -503,13 +902,21 @@ namespace quasi_succinct {
             std::vector<scored_enum> enums;
             enums.reserve(query_term_freqs.size());
 
+            float threshold = 0;
             for (auto term: query_term_freqs) {
                 auto list = index[term.first];
                 auto q_weight = scorer_type::query_term_weight
                     (term.second, list.size(), num_docs);
                 auto max_weight = q_weight * m_wdata.max_term_weight(term.first);
                 enums.push_back(scored_enum {std::move(list), q_weight, max_weight});
+                if (m_prime_threshold) {
+                    threshold = std::max(threshold,
+                                         single_term_threshold(m_wdata, term.first,
+                                                               q_weight, m_topk.k(),
+                                                               m_deleted));
+                }
             }
+            m_topk.set_threshold(threshold);
 
             std::vector<scored_enum*> ordered_enums;
             ordered_enums.reserve(enums.size());
@@ -529,7 +936,13 @@ namespace quasi_succinct {
                 upper_bounds[i] = upper_bounds[i - 1] + ordered_enums[i]->max_weight;
             }
 
+            // a primed threshold can make some lists non-essential upfront
             uint64_t non_essential_lists = 0;
+            while (non_essential_lists < ordered_enums.size() &&
+                   !m_topk.would_enter(upper_bounds[non_essential_lists])) {
+                non_essential_lists += 1;
+            }
+
             uint64_t cur_doc =
                 std::min_element(enums.begin(), enums.end(),
                                  [](scored_enum const& lhs, scored_enum const& rhs) {
@@ -539,13 +952,16 @@ namespace quasi_succinct {
 
             while (non_essential_lists < ordered_enums.size() &&
                    cur_doc < index.num_docs()) {
+                bool deleted = is_deleted(m_deleted, cur_doc);
                 float score = 0;
-                float norm_len = m_wdata.norm_len(cur_doc);
+                float len_factor = m_wdata.len_factor(cur_doc);
                 uint64_t next_doc = index.num_docs();
                 for (size_t i = non_essential_lists; i < ordered_enums.size(); ++i) {
                     if (ordered_enums[i]->docs_enum.docid() == cur_doc) {
-                        score += ordered_enums[i]->q_weight * scorer_type::doc_term_weight
-                            (ordered_enums[i]->docs_enum.freq(), norm_len);
+                        if (!deleted) {
+                            score += ordered_enums[i]->q_weight * scorer_type::doc_term_weight_from_factor
+                                (ordered_enums[i]->docs_enum.freq(), len_factor);
+                        }
                         ordered_enums[i]->docs_enum.next();
                     }
                     if (ordered_enums[i]->docs_enum.docid() < next_doc) {
@@ -553,23 +969,38 @@ namespace quasi_succinct {
                     }
                 }
 
+                // the non-essential lists are not needed to skip a deleted doc
+                if (deleted) {
+                    cur_doc = next_doc;
+                    continue;
+                }
+
                 // try to complete evaluation with non-essential lists
+                bool pruned = false;
                 for (size_t i = non_essential_lists - 1; i + 1 > 0; --i) {
                     if (!m_topk.would_enter(score + upper_bounds[i])) {
+                        pruned = true;
                         break;
                     }
                     ordered_enums[i]->docs_enum.next_geq(cur_doc);
                     if (ordered_enums[i]->docs_enum.docid() == cur_doc) {
-                        score += ordered_enums[i]->q_weight * scorer_type::doc_term_weight
-                            (ordered_enums[i]->docs_enum.freq(), norm_len);
+                        score += ordered_enums[i]->q_weight * scorer_type::doc_term_weight_from_factor
+                            (ordered_enums[i]->docs_enum.freq(), len_factor);
                     }
                 }
 
-                if (m_topk.insert(score)) {
-                    // update non-essential lists
-                    while (non_essential_lists < ordered_enums.size() &&
-                           !m_topk.would_enter(upper_bounds[non_essential_lists])) {
-                        non_essential_lists += 1;
+                // a pruned document cannot enter the top-k, so it is
+                // not inserted
+                if (pruned) {
+                    QS_COUNT(pruned_docs);
+                } else {
+                    QS_COUNT(scored_docs);
+                    if (m_topk.insert(score)) {
+                        // update non-essential lists
+                        while (non_essential_lists < ordered_enums.size() &&
+                               !m_topk.would_enter(upper_bounds[non_essential_lists])) {
+                            non_essential_lists += 1;
+                        }
                     }
                 }
 
@@ -587,8 +1018,12 @@ namespace quasi_succinct {
 
     private:
         wand_data<scorer_type> const& m_wdata;
-        topk_queue m_topk;
+        TopkQueue m_topk;
+        bool m_prime_threshold;
+        deleted_docs const* m_deleted;
     };
 
+    typedef basic_maxscore_query<topk_queue> maxscore_query;
+
 
 }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Counts of the enumerator and query operator events, to find out
+    // where the time of a slow query goes. They are compiled in only when
+    // QS_ENABLE_COUNTERS is defined (cmake -DQS_ENABLE_COUNTERS=ON);
+    // otherwise QS_COUNT expands to nothing. The counters are per thread.
+    //
+    // - next, next_geq: calls on the document enumerators of the indexes
+    // - ef_skips: Elias-Fano moves and next_geqs that use the skip pointers,
+    //   including the initial positioning of each enumerator
+    // - partition_switches: partitions entered by the partitioned sequences
+    // - block_decodes: docs and freqs blocks decoded by block indexes
+    // - scored_docs: documents fully scored by the ranked operators
+    // - pruned_docs: candidates discarded by the dynamic pruning, that is
+    //   WAND pivots not shared by all the preceding lists and MaxScore
+    //   documents whose evaluation stopped at the threshold; each
+    //   candidate is either scored or pruned
+    struct query_counters {
+        uint64_t next = 0;
+        uint64_t next_geq = 0;
+        uint64_t ef_skips = 0;
+        uint64_t partition_switches = 0;
+        uint64_t block_decodes = 0;
+        uint64_t scored_docs = 0;
+        uint64_t pruned_docs = 0;
+
+        void reset()
+        {
+            *this = query_counters();
+        }
+
+        query_counters& operator+=(query_counters const& other)
+        {
+            next += other.next;
+            next_geq += other.next_geq;
+            ef_skips += other.ef_skips;
+            partition_switches += other.partition_switches;
+            block_decodes += other.block_decodes;
+            scored_docs += other.scored_docs;
+            pruned_docs += other.pruned_docs;
+            return *this;
+        }
+
+        void dump(stats_line& line) const
+        {
+            line
+                ("next", next)
+                ("next_geq", next_geq)
+                ("ef_skips", ef_skips)
+                ("partition_switches", partition_switches)
+                ("block_decodes", block_decodes)
+                ("scored_docs", scored_docs)
+                ("pruned_docs", pruned_docs)
+                ;
+        }
+    };
+
+#ifdef QS_ENABLE_COUNTERS
+    inline query_counters& thread_query_counters()
+    {
+        static thread_local query_counters counters;
+        return counters;
+    }
+
+#   define QS_COUNT(COUNTER) (++::quasi_succinct::thread_query_counters().COUNTER)
+#else
+#   define QS_COUNT(COUNTER) ((void)0)
+#endif
+
+}
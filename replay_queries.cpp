@@ -0,0 +1,456 @@
+#include <iostream>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <boost/lexical_cast.hpp>
+
+#include <succinct/mapper.hpp>
+
+#include "configuration.hpp"
+#include "index_types.hpp"
+#include "wand_data.hpp"
+#include "queries.hpp"
+#include "latency_histogram.hpp"
+#include "numa.hpp"
+#include "util.hpp"
+
+// Open-loop replay of a query log: the queries arrive as a Poisson process
+// at the target rate, regardless of how fast they are served, and are
+// queued to a pool of worker threads. Unlike the closed-loop timings of
+// `queries`, the latencies include the time spent waiting in the queue,
+// which grows without bound when the rate exceeds the capacity of the
+// workers.
+//
+// With --numa the index and the wand data are copied into memory placed on
+// the NUMA nodes, and the workers are pinned to the nodes round-robin:
+// - local: one copy per node, each worker reads the copy of its node
+// - remote: one copy per node, each worker reads the copy of the next node
+// - interleave: one copy with the pages interleaved on all the nodes
+// Without it, the workers are not pinned and read the mapped files, placed
+// wherever the pages were first faulted.
+
+struct replay_params {
+    double qps;
+    size_t threads;
+    size_t num_queries;
+    uint64_t seed;
+    std::string numa; // none, local, remote or interleave
+};
+
+// A copy of the index and of the wand data
+template <typename IndexType>
+struct replica {
+    std::unique_ptr<quasi_succinct::numa::buffer> index_buffer;
+    std::unique_ptr<quasi_succinct::numa::buffer> wand_data_buffer;
+    IndexType index;
+    quasi_succinct::wand_data<> wdata;
+};
+
+// The replicas and, for each worker, its replica and CPUs
+template <typename IndexType>
+struct serving_layout {
+    std::vector<std::unique_ptr<replica<IndexType>>> replicas;
+    std::vector<size_t> worker_replica;
+    std::vector<std::vector<unsigned>> worker_cpus; // empty: not pinned
+};
+
+struct arrival {
+    size_t query;
+    double time; // usecs, from get_time_usecs()
+};
+
+// Queue from the dispatcher to the workers, closed once all the queries
+// have arrived
+class arrival_queue {
+public:
+    arrival_queue()
+        : m_closed(false)
+    {}
+
+    void push(arrival const& a)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(a);
+        }
+        m_cond.notify_one();
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_cond.notify_all();
+    }
+
+    // false once the queue is closed and empty
+    bool pop(arrival& a)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [&] { return m_closed || !m_queue.empty(); });
+        if (m_queue.empty()) return false;
+        a = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<arrival> m_queue;
+    bool m_closed;
+};
+
+// Waits until the given time; sleeps while far from it and spins for the
+// last stretch, as sleeps overshoot by tens of microseconds
+void wait_until(double time)
+{
+    using namespace quasi_succinct;
+    const double spin_usecs = 100;
+    double now;
+    while ((now = get_time_usecs()) < time) {
+        if (time - now > spin_usecs) {
+            std::this_thread::sleep_for(std::chrono::microseconds(uint64_t(time - now - spin_usecs)));
+        }
+    }
+}
+
+void log_latencies(std::string const& name, quasi_succinct::latency_histogram const& hist)
+{
+    using namespace quasi_succinct;
+    logger() << name << ": mean " << hist.mean()
+             << ", 50% " << hist.quantile(0.5)
+             << ", 99% " << hist.quantile(0.99)
+             << ", 99.9% " << hist.quantile(0.999)
+             << ", max " << hist.max() << std::endl;
+}
+
+void dump_latencies(std::string const& name, quasi_succinct::latency_histogram const& hist,
+                    quasi_succinct::stats_line& line)
+{
+    line
+        (name + "_avg", hist.mean())
+        (name + "_q50", hist.quantile(0.5))
+        (name + "_q90", hist.quantile(0.9))
+        (name + "_q99", hist.quantile(0.99))
+        (name + "_q999", hist.quantile(0.999))
+        (name + "_max", hist.max())
+        ;
+}
+
+template <typename IndexType, typename MakeOperator>
+void replay(serving_layout<IndexType> const& layout,
+            MakeOperator make_op,
+            std::vector<quasi_succinct::term_id_vec> const& queries,
+            std::string const& index_type,
+            std::string const& query_type,
+            replay_params const& params)
+{
+    using namespace quasi_succinct;
+
+    // untimed warmup run on each replica
+    for (auto const& r: layout.replicas) {
+        auto op = make_op(r->wdata);
+        for (auto const& query: queries) {
+            do_not_optimize_away(op(r->index, query));
+        }
+    }
+
+    // exponential inter-arrival times, the queries in log order, cycling
+    std::mt19937_64 rng(params.seed);
+    std::exponential_distribution<double> interarrival(params.qps / 1000000);
+    std::vector<double> offsets(params.num_queries);
+    double offset = 0;
+    for (auto& o: offsets) {
+        offset += interarrival(rng);
+        o = offset;
+    }
+
+    struct worker_stats {
+        latency_histogram queueing;
+        latency_histogram service;
+        latency_histogram response;
+        double last_end = 0;
+    };
+    std::vector<worker_stats> stats(params.threads);
+    arrival_queue queue;
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < params.threads; ++t) {
+        workers.emplace_back([&, t] {
+                if (!layout.worker_cpus[t].empty()) {
+                    numa::pin_thread(layout.worker_cpus[t]);
+                }
+                replica<IndexType> const& r = *layout.replicas[layout.worker_replica[t]];
+                auto op = make_op(r.wdata);
+                worker_stats& s = stats[t];
+                arrival a;
+                while (queue.pop(a)) {
+                    double start = get_time_usecs();
+                    uint64_t result = op(r.index, queries[a.query]);
+                    do_not_optimize_away(result);
+                    double end = get_time_usecs();
+                    s.queueing.add(start - a.time);
+                    s.service.add(end - start);
+                    s.response.add(end - a.time);
+                    s.last_end = end;
+                }
+            });
+    }
+
+    // the queries are timestamped with their scheduled arrival, so that a
+    // late dispatcher does not hide the delay
+    double begin = get_time_usecs();
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        double time = begin + offsets[i];
+        wait_until(time);
+        queue.push(arrival {i % queries.size(), time});
+    }
+    queue.close();
+    for (auto& w: workers) w.join();
+
+    worker_stats total;
+    for (auto const& s: stats) {
+        total.queueing.merge(s.queueing);
+        total.service.merge(s.service);
+        total.response.merge(s.response);
+        total.last_end = std::max(total.last_end, s.last_end);
+    }
+    double elapsed = total.last_end - begin;
+    double throughput = double(params.num_queries) * 1000000 / elapsed;
+    double offered = double(params.num_queries) * 1000000 / offsets.back();
+
+    logger() << "---- " << index_type << " " << query_type << std::endl;
+    logger() << "Target " << params.qps << " queries/s, offered " << offered
+             << ", achieved " << throughput << " with " << params.threads
+             << " threads" << std::endl;
+    log_latencies("Queueing", total.queueing);
+    log_latencies("Service", total.service);
+    log_latencies("Response", total.response);
+
+    stats_line line;
+    line
+        ("type", index_type)
+        ("query", query_type)
+        ("threads", params.threads)
+        ("numa", params.numa)
+        ("replicas", layout.replicas.size())
+        ("queries", params.num_queries)
+        ("target_qps", params.qps)
+        ("offered_qps", offered)
+        ("achieved_qps", throughput)
+        ;
+    dump_latencies("queueing", total.queueing, line);
+    dump_latencies("service", total.service, line);
+    dump_latencies("response", total.response, line);
+}
+
+// Returns false if the query type is unknown or needs a missing wand data
+template <typename IndexType>
+bool replay_queries(const char* index_filename,
+                    const char* wand_data_filename,
+                    std::vector<quasi_succinct::term_id_vec> const& queries,
+                    std::string const& type,
+                    std::string const& query_type,
+                    replay_params const& params)
+{
+    using namespace quasi_succinct;
+
+    logger() << "Loading index from " << index_filename << std::endl;
+    boost::iostreams::mapped_file_source m(index_filename);
+    boost::iostreams::mapped_file_source md;
+    if (wand_data_filename) {
+        md.open(wand_data_filename);
+    }
+
+    serving_layout<IndexType> layout;
+    auto add_replica = [&](std::vector<unsigned> const& node_ids, numa::policy p) {
+        std::unique_ptr<replica<IndexType>> r(new replica<IndexType>);
+        uint64_t flags = succinct::mapper::map_flags::warmup;
+        if (node_ids.empty()) {
+            succinct::mapper::map(r->index, m, flags);
+            if (wand_data_filename) succinct::mapper::map(r->wdata, md, flags);
+        } else {
+            r->index_buffer.reset(new numa::buffer(m.data(), m.size(), node_ids, p));
+            if (!r->index_buffer->placed()) {
+                logger() << "WARNING: could not place the index memory" << std::endl;
+            }
+            succinct::mapper::map(r->index, r->index_buffer->data(), flags);
+            if (wand_data_filename) {
+                r->wand_data_buffer.reset(new numa::buffer(md.data(), md.size(), node_ids, p));
+                if (!r->wand_data_buffer->placed()) {
+                    logger() << "WARNING: could not place the wand data memory" << std::endl;
+                }
+                succinct::mapper::map(r->wdata, r->wand_data_buffer->data(), flags);
+            }
+        }
+        layout.replicas.push_back(std::move(r));
+    };
+
+    if (params.numa == "none") {
+        add_replica({}, numa::policy::bind);
+        layout.worker_replica.assign(params.threads, 0);
+        layout.worker_cpus.resize(params.threads);
+    } else {
+        auto nodes = numa::nodes();
+        logger() << "Placing the index on " << nodes.size() << " NUMA nodes ("
+                 << params.numa << ")" << std::endl;
+        if (params.numa == "interleave") {
+            std::vector<unsigned> node_ids;
+            for (auto const& n: nodes) node_ids.push_back(n.id);
+            add_replica(node_ids, numa::policy::interleave);
+        } else {
+            for (auto const& n: nodes) {
+                add_replica({n.id}, numa::policy::bind);
+            }
+        }
+        for (size_t t = 0; t < params.threads; ++t) {
+            size_t node = t % nodes.size();
+            size_t rep = 0;
+            if (params.numa == "local") {
+                rep = node;
+            } else if (params.numa == "remote") {
+                rep = (node + 1) % nodes.size();
+            }
+            layout.worker_replica.push_back(rep);
+            layout.worker_cpus.push_back(nodes[node].cpus);
+        }
+    }
+
+    logger() << "Replaying " << params.num_queries << " " << query_type
+             << " queries at " << params.qps << " queries/s" << std::endl;
+
+    typedef wand_data<> const& wdata_ref;
+    if (query_type == "and") {
+        replay(layout, [](wdata_ref) { return and_query<false>(); },
+               queries, type, query_type, params);
+    } else if (query_type == "and_freq") {
+        replay(layout, [](wdata_ref) { return and_query<true>(); },
+               queries, type, query_type, params);
+    } else if (query_type == "or") {
+        replay(layout, [](wdata_ref) { return or_query<false>(); },
+               queries, type, query_type, params);
+    } else if (query_type == "or_freq") {
+        replay(layout, [](wdata_ref) { return or_query<true>(); },
+               queries, type, query_type, params);
+    } else if (!wand_data_filename) {
+        logger() << "ERROR: " << query_type << " queries need a wand data file" << std::endl;
+        return false;
+    } else if (query_type == "ranked_and") {
+        replay(layout, [](wdata_ref wdata) { return ranked_and_query(wdata, 10); },
+               queries, type, query_type, params);
+    } else if (query_type == "ranked_or") {
+        replay(layout, [](wdata_ref wdata) { return ranked_or_query(wdata, 10); },
+               queries, type, query_type, params);
+    } else if (query_type == "wand") {
+        replay(layout, [](wdata_ref wdata) { return wand_query(wdata, 10); },
+               queries, type, query_type, params);
+    } else if (query_type == "maxscore") {
+        replay(layout, [](wdata_ref wdata) { return maxscore_query(wdata, 10); },
+               queries, type, query_type, params);
+    } else {
+        logger() << "ERROR: Unknown query type " << query_type << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char** argv)
+{
+    using namespace quasi_succinct;
+
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <query type> <index filename> <queries/s>"
+                  << " [--wand <wand data filename>] [--threads <n>]"
+                  << " [--queries <n>] [--seed <n>]"
+                  << " [--numa none|local|remote|interleave] < queries" << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    std::string query_type = argv[2];
+    const char* index_filename = argv[3];
+    const char* wand_data_filename = nullptr;
+    replay_params params;
+    params.qps = boost::lexical_cast<double>(argv[4]);
+    // the arrival rate of the exponential distribution must be positive
+    if (!(params.qps > 0)) {
+        logger() << "ERROR: The rate must be positive" << std::endl;
+        return 1;
+    }
+    params.threads = std::max(size_t(1), configuration::get().worker_threads);
+    params.num_queries = 0;
+    params.seed = 42;
+    params.numa = "none";
+    for (int i = 5; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            logger() << "ERROR: Missing value for option " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--wand") {
+            wand_data_filename = argv[i + 1];
+        } else if (arg == "--threads") {
+            params.threads = boost::lexical_cast<size_t>(argv[i + 1]);
+            if (!params.threads) {
+                logger() << "ERROR: --threads must be at least 1" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--queries") {
+            params.num_queries = boost::lexical_cast<size_t>(argv[i + 1]);
+        } else if (arg == "--seed") {
+            params.seed = boost::lexical_cast<uint64_t>(argv[i + 1]);
+        } else if (arg == "--numa") {
+            params.numa = argv[i + 1];
+            if (params.numa != "none" && params.numa != "local" &&
+                params.numa != "remote" && params.numa != "interleave") {
+                logger() << "ERROR: Unknown NUMA placement " << params.numa << std::endl;
+                return 1;
+            }
+            // with a single node every copy is local, and the results
+            // would be mislabeled
+            size_t num_nodes = numa::nodes().size();
+            if (params.numa == "remote" && num_nodes < 2) {
+                logger() << "ERROR: --numa remote needs at least 2 NUMA nodes, found "
+                         << num_nodes << std::endl;
+                return 1;
+            }
+        } else {
+            logger() << "ERROR: Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<term_id_vec> queries;
+    term_id_vec q;
+    while (read_query(q)) queries.push_back(q);
+    if (queries.empty()) {
+        logger() << "ERROR: No queries" << std::endl;
+        return 1;
+    }
+    // by default each query of the log arrives once
+    if (!params.num_queries) params.num_queries = queries.size();
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                           \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {                     \
+            if (!replay_queries<BOOST_PP_CAT(T, _index)>                \
+                (index_filename, wand_data_filename, queries,           \
+                 type, query_type, params)) {                           \
+                return 1;                                               \
+            }                                                           \
+            /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << type << std::endl;
+        return 1;
+    }
+}
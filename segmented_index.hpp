@@ -0,0 +1,528 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "global_parameters.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // An index that grows by documents. New documents go to a mutable
+    // in-memory delta of uncompressed postings; when the delta reaches
+    // max_delta_docs documents it is sealed into an immutable segment,
+    // and a background thread compresses the sealed deltas and merges the
+    // newest segments into IndexType segments. A run of newest segments
+    // is merged when the older segment before it is at most merge_factor
+    // times their total size, so each posting is merged a logarithmic
+    // number of times.
+    //
+    // Queries run on snapshots, which share the immutable segments: taking
+    // a snapshot freezes the documents added to the delta since the
+    // previous one into an immutable chunk, which is moved rather than
+    // copied, so updates and merges never block the queries, and a
+    // snapshot does not change once taken. The enumerators own their
+    // snapshot, so they stay valid after it is released. A snapshot has
+    // the interface of freq_index (num_docs, size, operator[]) on the
+    // global docids, so the operators in queries.hpp run on it unchanged;
+    // the ranked ones need a wand_data covering all the documents.
+    template <typename IndexType>
+    class segmented_index {
+        // the delta is sealed early when it is split in more chunks than
+        // this, bounding the parts that an enumerator has to visit
+        static const size_t max_delta_chunks = 16;
+
+    public:
+        // (term, freq) pairs of a document, with distinct terms
+        typedef std::vector<std::pair<uint64_t, uint64_t>> document_terms;
+
+    private:
+        struct delta_list {
+            std::vector<uint64_t> docs;
+            std::vector<uint64_t> freqs;
+        };
+
+        struct delta_segment {
+            delta_segment()
+                : num_docs(0)
+            {}
+
+            std::unordered_map<uint64_t, delta_list> lists;
+            uint64_t num_docs;
+        };
+
+        struct segment {
+            uint64_t base;
+            uint64_t num_docs;
+            // either a compressed index, whose i-th list is of the term
+            // terms[i], or an uncompressed delta
+            std::shared_ptr<const IndexType> index;
+            std::vector<uint64_t> terms;
+            std::shared_ptr<const delta_segment> delta;
+
+            uint64_t postings() const
+            {
+                uint64_t ret = 0;
+                if (index) {
+                    for (size_t i = 0; i < index->size(); ++i) {
+                        ret += (*index)[i].size();
+                    }
+                } else {
+                    for (auto const& list: delta->lists) {
+                        ret += list.second.docs.size();
+                    }
+                }
+                return ret;
+            }
+        };
+
+        typedef std::shared_ptr<const segment> segment_ptr;
+
+    public:
+        class snapshot : public std::enable_shared_from_this<snapshot> {
+        public:
+            class document_enumerator {
+            public:
+                void QS_FLATTEN_FUNC next()
+                {
+                    auto const& p = m_parts[m_cur];
+                    if (at_end()) return;
+                    if (p.delta) {
+                        m_delta_pos += 1;
+                    } else {
+                        m_enums[p.idx].next();
+                    }
+                    update();
+                }
+
+                void QS_FLATTEN_FUNC next_geq(uint64_t lower_bound)
+                {
+                    if (lower_bound <= m_cur_docid) return;
+                    while (lower_bound >= m_parts[m_cur].end) {
+                        m_cur += 1;
+                        m_delta_pos = 0;
+                    }
+                    auto const& p = m_parts[m_cur];
+                    if (!at_end() && lower_bound > p.base) {
+                        uint64_t local = lower_bound - p.base;
+                        if (p.delta) {
+                            auto const& docs = p.delta->docs;
+                            m_delta_pos = std::lower_bound(docs.begin() + m_delta_pos,
+                                                           docs.end(), local)
+                                - docs.begin();
+                        } else if (m_enums[p.idx].docid() < local) {
+                            m_enums[p.idx].next_geq(local);
+                        }
+                    }
+                    update();
+                }
+
+                uint64_t docid() const
+                {
+                    return m_cur_docid;
+                }
+
+                uint64_t freq()
+                {
+                    auto const& p = m_parts[m_cur];
+                    if (p.delta) {
+                        return p.delta->freqs[m_delta_pos];
+                    }
+                    return m_enums[p.idx].freq();
+                }
+
+                uint64_t size() const
+                {
+                    return m_size;
+                }
+
+            private:
+                friend class snapshot;
+
+                struct part {
+                    uint64_t base;
+                    uint64_t end;
+                    delta_list const* delta; // if null, m_enums[idx]
+                    size_t idx;
+                };
+
+                document_enumerator()
+                    : m_size(0)
+                    , m_cur(0)
+                    , m_delta_pos(0)
+                    , m_cur_docid(0)
+                {}
+
+                void start(uint64_t num_docs)
+                {
+                    // sentinel part, so that the end is a regular position
+                    m_parts.push_back(part { num_docs, uint64_t(-1), nullptr, 0 });
+                    update();
+                }
+
+                bool at_end() const
+                {
+                    return m_cur + 1 == m_parts.size();
+                }
+
+                // moves to the first part not exhausted
+                void update()
+                {
+                    while (true) {
+                        auto const& p = m_parts[m_cur];
+                        if (at_end()) {
+                            m_cur_docid = p.base;
+                            return;
+                        }
+                        uint64_t local;
+                        if (p.delta) {
+                            local = m_delta_pos < p.delta->docs.size()
+                                ? p.delta->docs[m_delta_pos] : p.end - p.base;
+                        } else {
+                            local = m_enums[p.idx].docid();
+                        }
+                        if (p.base + local < p.end) {
+                            m_cur_docid = p.base + local;
+                            return;
+                        }
+                        m_cur += 1;
+                        m_delta_pos = 0;
+                    }
+                }
+
+                // keeps alive the delta lists and indexes referenced by
+                // the parts
+                std::shared_ptr<const snapshot> m_snapshot;
+                std::vector<typename IndexType::document_enumerator> m_enums;
+                std::vector<part> m_parts;
+                uint64_t m_size;
+                size_t m_cur;
+                uint64_t m_delta_pos;
+                uint64_t m_cur_docid;
+            };
+
+            uint64_t num_docs() const
+            {
+                return m_num_docs;
+            }
+
+            // number of terms
+            uint64_t size() const
+            {
+                return m_num_terms;
+            }
+
+            size_t num_segments() const
+            {
+                return m_segments.size();
+            }
+
+            document_enumerator operator[](uint64_t term) const
+            {
+                document_enumerator e;
+                e.m_snapshot = this->shared_from_this();
+                for (auto const& seg: m_segments) {
+                    typename document_enumerator::part p = {
+                        seg->base, seg->base + seg->num_docs, nullptr, 0
+                    };
+                    if (seg->index) {
+                        auto it = std::lower_bound(seg->terms.begin(), seg->terms.end(), term);
+                        if (it == seg->terms.end() || *it != term) continue;
+                        p.idx = e.m_enums.size();
+                        e.m_enums.push_back((*seg->index)[it - seg->terms.begin()]);
+                        e.m_size += e.m_enums.back().size();
+                    } else {
+                        auto it = seg->delta->lists.find(term);
+                        if (it == seg->delta->lists.end()) continue;
+                        p.delta = &it->second;
+                        e.m_size += p.delta->docs.size();
+                    }
+                    e.m_parts.push_back(p);
+                }
+                e.start(m_num_docs);
+                return e;
+            }
+
+        private:
+            friend class segmented_index;
+
+            std::vector<segment_ptr> m_segments;
+            uint64_t m_num_docs;
+            uint64_t m_num_terms;
+        };
+
+        segmented_index(global_parameters const& params,
+                        uint64_t max_delta_docs = 1 << 16,
+                        double merge_factor = 1)
+            : m_params(params)
+            , m_max_delta_docs(max_delta_docs)
+            , m_merge_factor(merge_factor)
+            , m_sealed_docs(0)
+            , m_frozen_docs(0)
+            , m_num_terms(0)
+            , m_merge_pending(false)
+            , m_merging(false)
+            , m_stop(false)
+        {
+            m_merge_thread = std::thread([this] { merge_loop(); });
+        }
+
+        ~segmented_index()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_merge_cond.notify_all();
+            m_merge_thread.join();
+        }
+
+        // Appends an already built index, whose i-th list is of the term
+        // i, after the current documents; the delta is sealed first
+        void add_segment(std::shared_ptr<const IndexType> index)
+        {
+            auto seg = std::make_shared<segment>();
+            seg->num_docs = index->num_docs();
+            seg->index = index;
+            seg->terms.resize(index->size());
+            std::iota(seg->terms.begin(), seg->terms.end(), uint64_t(0));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            seal_delta();
+            seg->base = m_sealed_docs;
+            m_sealed_docs += seg->num_docs;
+            m_num_terms = std::max(m_num_terms, uint64_t(index->size()));
+            m_segments.push_back(seg);
+            m_snapshot.reset();
+        }
+
+        // Returns the docid of the added document
+        uint64_t add_document(document_terms const& terms)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            uint64_t docid = m_sealed_docs + m_frozen_docs + m_delta.num_docs;
+            uint64_t local = m_delta.num_docs;
+            for (auto const& tf: terms) {
+                auto& list = m_delta.lists[tf.first];
+                list.docs.push_back(local);
+                list.freqs.push_back(tf.second);
+                m_num_terms = std::max(m_num_terms, tf.first + 1);
+            }
+            m_delta.num_docs += 1;
+            m_snapshot.reset();
+
+            if (m_frozen_docs + m_delta.num_docs >= m_max_delta_docs) {
+                seal_delta();
+            }
+            return docid;
+        }
+
+        // Seals the delta, so that it gets compressed
+        void flush()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            seal_delta();
+        }
+
+        // Blocks until the pending merges are done
+        void wait_merges()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_idle_cond.wait(lock, [this] { return !m_merge_pending && !m_merging; });
+        }
+
+        std::shared_ptr<const snapshot> get_snapshot()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_snapshot) {
+                freeze_delta();
+                if (m_delta_chunks.size() > max_delta_chunks) {
+                    seal_delta();
+                }
+                std::shared_ptr<snapshot> snap(new snapshot());
+                snap->m_segments = m_segments;
+                snap->m_segments.insert(snap->m_segments.end(),
+                                        m_delta_chunks.begin(), m_delta_chunks.end());
+                snap->m_num_docs = m_sealed_docs + m_frozen_docs;
+                snap->m_num_terms = m_num_terms;
+                m_snapshot = snap;
+            }
+            return m_snapshot;
+        }
+
+    private:
+        // called with m_mutex held; moves the mutable part of the delta
+        // to a new immutable chunk
+        void freeze_delta()
+        {
+            if (!m_delta.num_docs) return;
+            auto seg = std::make_shared<segment>();
+            seg->base = m_sealed_docs + m_frozen_docs;
+            seg->num_docs = m_delta.num_docs;
+            seg->delta = std::make_shared<delta_segment>(std::move(m_delta));
+            m_delta = delta_segment();
+            m_frozen_docs += seg->num_docs;
+            m_delta_chunks.push_back(seg);
+        }
+
+        // called with m_mutex held
+        void seal_delta()
+        {
+            freeze_delta();
+            if (m_delta_chunks.empty()) return;
+            m_segments.insert(m_segments.end(),
+                              m_delta_chunks.begin(), m_delta_chunks.end());
+            m_delta_chunks.clear();
+            m_sealed_docs += m_frozen_docs;
+            m_frozen_docs = 0;
+            m_snapshot.reset();
+
+            m_merge_pending = true;
+            m_merge_cond.notify_all();
+        }
+
+        // called with m_mutex held; the uncompressed segments are always
+        // the newest ones, and are always merged
+        bool choose_merge(size_t& begin, size_t& end) const
+        {
+            end = m_segments.size();
+            if (!end) return false;
+            begin = end;
+            while (begin > 0 && m_segments[begin - 1]->delta) {
+                begin -= 1;
+            }
+            if (begin == end) begin = end - 1;
+
+            uint64_t merged_docs = 0;
+            for (size_t i = begin; i < end; ++i) {
+                merged_docs += m_segments[i]->num_docs;
+            }
+            while (begin > 0 &&
+                   m_segments[begin - 1]->num_docs <= m_merge_factor * merged_docs) {
+                begin -= 1;
+                merged_docs += m_segments[begin]->num_docs;
+            }
+            return end - begin >= 2 || m_segments[begin]->delta;
+        }
+
+        void merge_loop()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true) {
+                m_merge_cond.wait(lock, [this] { return m_stop || m_merge_pending; });
+                if (m_stop) return;
+                m_merge_pending = false;
+
+                size_t begin, end;
+                while (!m_stop && choose_merge(begin, end)) {
+                    std::vector<segment_ptr> segments(m_segments.begin() + begin,
+                                                      m_segments.begin() + end);
+                    uint64_t num_terms = m_num_terms;
+                    m_merging = true;
+
+                    lock.unlock();
+                    auto merged = merge_segments(segments, num_terms);
+                    lock.lock();
+
+                    // only this thread removes segments, so they are still
+                    // at the same positions
+                    m_segments.erase(m_segments.begin() + begin,
+                                     m_segments.begin() + end);
+                    m_segments.insert(m_segments.begin() + begin, merged);
+                    m_snapshot.reset();
+                    m_merging = false;
+                }
+                m_idle_cond.notify_all();
+            }
+        }
+
+        segment_ptr merge_segments(std::vector<segment_ptr> const& segments,
+                                   uint64_t num_terms) const
+        {
+            auto merged = std::make_shared<segment>();
+            merged->base = segments.front()->base;
+            merged->num_docs = 0;
+            uint64_t postings = 0;
+            for (auto const& seg: segments) {
+                merged->num_docs += seg->num_docs;
+                postings += seg->postings();
+            }
+
+            // the builder reads the lists asynchronously, so they are
+            // accumulated in buffers that are never reallocated
+            std::vector<uint64_t> docs, freqs;
+            docs.reserve(postings);
+            freqs.reserve(postings);
+            typename IndexType::builder builder(merged->num_docs, m_params);
+            std::vector<size_t> term_pos(segments.size(), 0);
+
+            for (uint64_t term = 0; term < num_terms; ++term) {
+                size_t list_begin = docs.size();
+                uint64_t occurrences = 0;
+                for (size_t s = 0; s < segments.size(); ++s) {
+                    auto const& seg = *segments[s];
+                    uint64_t offset = seg.base - merged->base;
+                    if (seg.index) {
+                        auto& pos = term_pos[s];
+                        if (pos == seg.terms.size() || seg.terms[pos] != term) continue;
+                        auto e = (*seg.index)[pos++];
+                        for (size_t i = 0; i < e.size(); ++i, e.next()) {
+                            docs.push_back(offset + e.docid());
+                            freqs.push_back(e.freq());
+                            occurrences += freqs.back();
+                        }
+                    } else {
+                        auto it = seg.delta->lists.find(term);
+                        if (it == seg.delta->lists.end()) continue;
+                        for (size_t i = 0; i < it->second.docs.size(); ++i) {
+                            docs.push_back(offset + it->second.docs[i]);
+                            freqs.push_back(it->second.freqs[i]);
+                            occurrences += freqs.back();
+                        }
+                    }
+                }
+
+                if (docs.size() != list_begin) {
+                    merged->terms.push_back(term);
+                    builder.add_posting_list(docs.size() - list_begin,
+                                             docs.begin() + list_begin,
+                                             freqs.begin() + list_begin,
+                                             occurrences);
+                }
+            }
+
+            auto index = std::make_shared<IndexType>();
+            builder.build(*index);
+            merged->index = index;
+            return merged;
+        }
+
+        global_parameters m_params;
+        uint64_t m_max_delta_docs;
+        double m_merge_factor;
+
+        std::mutex m_mutex;
+        std::vector<segment_ptr> m_segments;
+        uint64_t m_sealed_docs;
+        // the delta is split in the chunks frozen by the snapshots, that
+        // follow the sealed segments, and the mutable m_delta
+        std::vector<segment_ptr> m_delta_chunks;
+        uint64_t m_frozen_docs;
+        delta_segment m_delta;
+        uint64_t m_num_terms;
+        std::shared_ptr<const snapshot> m_snapshot;
+
+        std::condition_variable m_merge_cond;
+        std::condition_variable m_idle_cond;
+        bool m_merge_pending;
+        bool m_merging;
+        bool m_stop;
+        std::thread m_merge_thread;
+    };
+}
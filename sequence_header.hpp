@@ -0,0 +1,73 @@
+#pragma once
+
+#include <type_traits>
+#include <succinct/bit_vector.hpp>
+
+#include "global_parameters.hpp"
+
+namespace quasi_succinct {
+
+    // An encoded sequence, as written by Sequence::write, occupying the
+    // bits [begin, end) of bv; used to merge sequences without decoding
+    // them. A sequence with n = 0 is absent.
+    struct encoded_sequence {
+        encoded_sequence()
+            : bv(nullptr), begin(0), end(0), universe(0), n(0)
+        {}
+
+        succinct::bit_vector const* bv;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t universe;
+        uint64_t n;
+    };
+
+    // Access to the pre-parsed header of a sequence, used to build
+    // enumerators without re-reading the variable-length fields at the
+    // beginning of the sequence. Sequences opt in by defining a POD
+    // header_type, a static read_header() with the same arguments as the
+    // enumerator plus the header to fill, and an enumerator constructor
+    // taking the header as additional last argument. For the other
+    // sequences the header is empty and the enumerator is constructed as
+    // usual. The headers are read in place and only their fields are
+    // assigned, so that a zeroed padding stays zero.
+    template <typename Sequence, typename Enable = void>
+    struct sequence_header {
+        struct type {};
+
+        static void read(succinct::bit_vector const&, uint64_t,
+                         uint64_t, uint64_t, global_parameters const&, type&)
+        {}
+
+        static typename Sequence::enumerator
+        enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                   uint64_t universe, uint64_t n,
+                   global_parameters const& params, type const&)
+        {
+            return typename Sequence::enumerator(bv, offset, universe, n, params);
+        }
+    };
+
+    template <typename Sequence>
+    struct sequence_header<Sequence,
+                           typename std::enable_if<
+                               std::is_class<typename Sequence::header_type>::value
+                               >::type> {
+        typedef typename Sequence::header_type type;
+
+        static void read(succinct::bit_vector const& bv, uint64_t offset,
+                         uint64_t universe, uint64_t n,
+                         global_parameters const& params, type& header)
+        {
+            Sequence::read_header(bv, offset, universe, n, params, header);
+        }
+
+        static typename Sequence::enumerator
+        enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                   uint64_t universe, uint64_t n,
+                   global_parameters const& params, type const& header)
+        {
+            return typename Sequence::enumerator(bv, offset, universe, n, params, header);
+        }
+    };
+}
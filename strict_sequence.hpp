@@ -48,6 +48,43 @@ namespace quasi_succinct {
             return best_cost;
         }
 
+        // Encoding minimizing its size plus lambda times its estimated
+        // access time; with lambda = 0 this is the smallest encoding.
+        // all_ones is always chosen when applicable, as it is implicit.
+        static QS_FLATTEN_FUNC index_type
+        choose_type(global_parameters const& params, uint64_t universe, uint64_t n,
+                    access_time_model const& model, double lambda,
+                    uint64_t& best_cost)
+        {
+            auto sparams = strict_params(params);
+            if (all_ones_sequence::bitsize(params, universe, n) == 0) {
+                best_cost = time_cost(lambda, model.all_ones(universe, n));
+                return all_ones;
+            }
+
+            index_type best_type = elias_fano;
+            best_cost = strict_elias_fano::bitsize(sparams, universe, n) + type_bits
+                + time_cost(lambda, model.elias_fano(universe, n));
+
+            uint64_t rb_cost = compact_ranked_bitvector::bitsize(sparams, universe, n) + type_bits
+                + time_cost(lambda, model.ranked_bitvector(universe, n));
+            if (rb_cost < best_cost) {
+                best_cost = rb_cost;
+                best_type = ranked_bitvector;
+            }
+
+            return best_type;
+        }
+
+        static QS_FLATTEN_FUNC uint64_t
+        space_time_cost(global_parameters const& params, uint64_t universe, uint64_t n,
+                        access_time_model const& model, double lambda)
+        {
+            uint64_t cost;
+            choose_type(params, universe, n, model, lambda, cost);
+            return cost;
+        }
+
         template <typename Iterator>
         static void write(succinct::bit_vector_builder& bvb,
                           Iterator begin,
@@ -55,22 +92,12 @@ namespace quasi_succinct {
                           global_parameters const& params)
         {
             auto sparams = strict_params(params);
-            uint64_t best_cost = all_ones_sequence::bitsize(params, universe, n);
-            int best_type = all_ones;
-
-            if (best_cost) {
-                uint64_t ef_cost = strict_elias_fano::bitsize(sparams, universe, n) + type_bits;
-                if (ef_cost < best_cost) {
-                    best_cost = ef_cost;
-                    best_type = elias_fano;
-                }
-
-                uint64_t rb_cost = compact_ranked_bitvector::bitsize(sparams, universe, n) + type_bits;
-                if (rb_cost < best_cost) {
-                    best_cost = rb_cost;
-                    best_type = ranked_bitvector;
-                }
+            uint64_t best_cost;
+            int best_type = choose_type(params, universe, n,
+                                        params.access_time, params.space_time_lambda,
+                                        best_cost);
 
+            if (best_type != all_ones) {
                 bvb.append_bits(best_type, type_bits);
             }
 
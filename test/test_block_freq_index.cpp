@@ -11,9 +11,9 @@
 #include <algorithm>
 
 template <typename BlockCodec>
-void test_block_freq_index()
+void test_block_freq_index(quasi_succinct::global_parameters const& params =
+                           quasi_succinct::global_parameters())
 {
-    quasi_succinct::global_parameters params;
     uint64_t universe = 20000;
     typedef quasi_succinct::block_freq_index<BlockCodec> collection_type;
     typename collection_type::builder b(universe, params);
@@ -64,4 +64,8 @@ BOOST_AUTO_TEST_CASE(block_freq_index)
     test_block_freq_index<quasi_succinct::optpfor_block>();
     test_block_freq_index<quasi_succinct::varint_G8IU_block>();
     test_block_freq_index<quasi_succinct::interpolative_block>();
+
+    quasi_succinct::global_parameters flat_params;
+    flat_params.flat_endpoints = 1;
+    test_block_freq_index<quasi_succinct::optpfor_block>(flat_params);
 }
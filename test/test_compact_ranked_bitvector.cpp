@@ -86,3 +86,58 @@ BOOST_FIXTURE_TEST_CASE(compact_ranked_bitvector_enumerator,
                                                            params);
     test_sequence(r, seq);
 }
+
+BOOST_FIXTURE_TEST_CASE(compact_ranked_bitvector_scans,
+                        sequence_initialization)
+{
+    using namespace quasi_succinct;
+    compact_ranked_bitvector::offsets of(0, universe, seq.size(), params);
+    uint64_t const* data = bv.data().data();
+
+    for (size_t i = 0; i < 10000; ++i) {
+        uint64_t begin = rand() % (seq.back() + 1);
+        uint64_t end = std::min(begin + rand() % 4096, seq.back() + 1);
+        uint64_t expected =
+            std::lower_bound(seq.begin(), seq.end(), end) -
+            std::lower_bound(seq.begin(), seq.end(), begin);
+        MY_REQUIRE_EQUAL(expected,
+                         bit_scan::popcount(data, of.bits_offset + begin,
+                                            of.bits_offset + end),
+                         "begin = " << begin << " end = " << end);
+        MY_REQUIRE_EQUAL(expected,
+                         bit_scan::popcount_scalar(data, of.bits_offset + begin,
+                                                   of.bits_offset + end),
+                         "begin = " << begin << " end = " << end);
+        MY_REQUIRE_EQUAL(*std::lower_bound(seq.begin(), seq.end(), begin),
+                         bit_scan::next_one(data, of.bits_offset + begin, of.end)
+                         - of.bits_offset,
+                         "begin = " << begin);
+    }
+
+    // the dispatched AND of two unaligned ranges matches the scalar one
+    uint64_t data_bits = bv.data().size() * 64;
+    for (size_t i = 0; i < 1000; ++i) {
+        uint64_t a_pos = rand() % (data_bits - 320);
+        uint64_t b_pos = rand() % (data_bits - 320);
+        uint64_t expected[4], words[4];
+        bit_scan::and_256_scalar(data, a_pos, data, b_pos, expected);
+        bit_scan::and_256(data, a_pos, data, b_pos, words);
+        for (size_t w = 0; w < 4; ++w) {
+            MY_REQUIRE_EQUAL(expected[w], words[w],
+                             "a_pos = " << a_pos << " b_pos = " << b_pos);
+            MY_REQUIRE_EQUAL((bv.get_word(a_pos + w * 64) & bv.get_word(b_pos + w * 64)),
+                             words[w],
+                             "a_pos = " << a_pos << " b_pos = " << b_pos);
+        }
+    }
+
+    // default sampling, so that next_geq scans longer stretches
+    global_parameters default_params;
+    succinct::bit_vector_builder bvb;
+    compact_ranked_bitvector::write(bvb, seq.begin(), universe, seq.size(),
+                                    default_params);
+    succinct::bit_vector default_bv(&bvb);
+    compact_ranked_bitvector::enumerator r(default_bv, 0, universe, seq.size(),
+                                           default_params);
+    test_sequence(r, seq);
+}
@@ -0,0 +1,58 @@
+#define BOOST_TEST_MODULE compressed_freq_collection
+
+#include "succinct/test_common.hpp"
+
+#include <cstdio>
+
+#include "binary_freq_collection.hpp"
+#include "compressed_freq_collection.hpp"
+#include "index_types.hpp"
+
+BOOST_AUTO_TEST_CASE(compressed_freq_collection)
+{
+    using namespace quasi_succinct;
+    binary_freq_collection input("test_data/test_collection"); // XXX path should be absolute
+    std::string basename = "temp_compressed_collection";
+    quasi_succinct::compressed_freq_collection::write(input, basename);
+
+    quasi_succinct::compressed_freq_collection coll(basename.c_str());
+    BOOST_REQUIRE_EQUAL(input.num_docs(), coll.num_docs());
+
+    // the lists must be the same, in the same order
+    auto it = coll.begin();
+    size_t lists = 0;
+    for (auto const& plist: input) {
+        BOOST_REQUIRE(it != coll.end());
+        BOOST_REQUIRE_EQUAL(plist.docs.size(), it->docs.size());
+        BOOST_REQUIRE(std::equal(plist.docs.begin(), plist.docs.end(), it->docs.begin()));
+        BOOST_REQUIRE(std::equal(plist.freqs.begin(), plist.freqs.end(), it->freqs.begin()));
+        ++it;
+        ++lists;
+    }
+    BOOST_REQUIRE(it == coll.end());
+    BOOST_REQUIRE_EQUAL(lists, coll.size());
+
+    // the builder reads the lists after the iterator has moved on
+    global_parameters params;
+    opt_index::builder builder(coll.num_docs(), params);
+    for (auto const& plist: coll) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                             plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                 plist.freqs.begin(), freqs_sum);
+    }
+    opt_index index;
+    builder.build(index);
+
+    size_t term = 0;
+    for (auto const& plist: input) {
+        auto e = index[term++];
+        BOOST_REQUIRE_EQUAL(plist.docs.size(), e.size());
+        for (size_t i = 0; i < e.size(); ++i, e.next()) {
+            MY_REQUIRE_EQUAL(*(plist.docs.begin() + i), e.docid(), "i = " << i);
+            MY_REQUIRE_EQUAL(*(plist.freqs.begin() + i), e.freq(), "i = " << i);
+        }
+    }
+
+    std::remove(quasi_succinct::compressed_freq_collection::filename(basename).c_str());
+}
@@ -10,14 +10,16 @@
 #include <succinct/mapper.hpp>
 
 #include <vector>
+#include <fstream>
+#include <cstdio>
 #include <cstdlib>
 #include <algorithm>
 #include <numeric>
 
 template <typename DocsSequence, typename FreqsSequence>
-void test_freq_index()
+void test_freq_index(quasi_succinct::global_parameters const& params =
+                     quasi_succinct::global_parameters())
 {
-    quasi_succinct::global_parameters params;
     uint64_t universe = 20000;
     typedef quasi_succinct::freq_index<DocsSequence, FreqsSequence>
         collection_type;
@@ -81,4 +83,154 @@ BOOST_AUTO_TEST_CASE(freq_index)
                     positive_sequence<partitioned_sequence<strict_sequence>>>();
     test_freq_index<uniform_partitioned_sequence<>,
                     positive_sequence<uniform_partitioned_sequence<strict_sequence>>>();
+
+    quasi_succinct::global_parameters flat_params;
+    flat_params.flat_endpoints = 1;
+    test_freq_index<partitioned_sequence<>,
+                    positive_sequence<partitioned_sequence<strict_sequence>>>(flat_params);
+
+    quasi_succinct::global_parameters headers_params;
+    headers_params.list_headers = 1;
+    test_freq_index<indexed_sequence,
+                    positive_sequence<>>(headers_params);
+    test_freq_index<partitioned_sequence<>,
+                    positive_sequence<partitioned_sequence<strict_sequence>>>(headers_params);
+    test_freq_index<uniform_partitioned_sequence<>,
+                    positive_sequence<uniform_partitioned_sequence<strict_sequence>>>(headers_params);
+}
+
+typedef std::vector<std::pair<std::vector<uint64_t>, std::vector<uint64_t>>> posting_lists_type;
+
+template <typename Collection>
+void build_random_index(uint64_t universe, size_t num_lists,
+                        quasi_succinct::global_parameters const& params,
+                        posting_lists_type& posting_lists, Collection& coll)
+{
+    typename Collection::builder b(universe, params);
+    posting_lists.resize(num_lists);
+    for (size_t i = 0; i < num_lists; ++i) {
+        auto& plist = posting_lists[i];
+        // mix of long lists and short single-partition ones
+        double avg_gap = (i % 3 == 0)
+            ? universe / double(1 + rand() % 50)
+            : 1.1 + double(rand()) / RAND_MAX * 10;
+        uint64_t n = std::max(uint64_t(1), uint64_t(universe / avg_gap));
+        plist.first = random_sequence(universe, n, true);
+        plist.second.resize(n);
+        std::generate(plist.second.begin(), plist.second.end(),
+                      []() { return (rand() % 256) + 1; });
+        uint64_t freqs_sum = std::accumulate(plist.second.begin(),
+                                             plist.second.end(), uint64_t(0));
+        b.add_posting_list(n, plist.first.begin(), plist.second.begin(), freqs_sum);
+    }
+    b.build(coll);
+}
+
+void test_merged_freq_index(size_t a_lists, size_t b_lists,
+                            quasi_succinct::global_parameters const& params =
+                            quasi_succinct::global_parameters())
+{
+    using namespace quasi_succinct;
+    typedef quasi_succinct::freq_index<partitioned_sequence<>,
+                                       positive_sequence<partitioned_sequence<strict_sequence>>>
+        collection_type;
+
+    uint64_t a_universe = 20000, b_universe = 15000;
+    posting_lists_type a_plists, b_plists;
+    collection_type a, b;
+    build_random_index(a_universe, a_lists, params, a_plists, a);
+    build_random_index(b_universe, b_lists, params, b_plists, b);
+
+    collection_type merged;
+    collection_type::builder builder(a_universe + b_universe, params);
+    size_t num_lists = std::max(a_lists, b_lists);
+    for (size_t term = 0; term < num_lists; ++term) {
+        builder.add_merged_list(a, b, term);
+    }
+    builder.build(merged);
+
+    BOOST_REQUIRE_EQUAL(num_lists, merged.size());
+    BOOST_REQUIRE_EQUAL(a_universe + b_universe, merged.num_docs());
+    for (size_t term = 0; term < num_lists; ++term) {
+        std::vector<std::pair<uint64_t, uint64_t>> expected;
+        if (term < a_lists) {
+            for (size_t p = 0; p < a_plists[term].first.size(); ++p) {
+                expected.emplace_back(a_plists[term].first[p], a_plists[term].second[p]);
+            }
+        }
+        if (term < b_lists) {
+            for (size_t p = 0; p < b_plists[term].first.size(); ++p) {
+                expected.emplace_back(a_universe + b_plists[term].first[p],
+                                      b_plists[term].second[p]);
+            }
+        }
+
+        auto doc_enum = merged[term];
+        BOOST_REQUIRE_EQUAL(expected.size(), doc_enum.size());
+        for (size_t p = 0; p < expected.size(); ++p, doc_enum.next()) {
+            MY_REQUIRE_EQUAL(expected[p].first, doc_enum.docid(),
+                             "term = " << term << " p = " << p);
+            MY_REQUIRE_EQUAL(expected[p].second, doc_enum.freq(),
+                             "term = " << term << " p = " << p);
+        }
+        BOOST_REQUIRE_EQUAL(merged.num_docs(), doc_enum.docid());
+
+        auto geq_enum = merged[term];
+        for (size_t p = 0; p < expected.size(); p += 7) {
+            geq_enum.next_geq(expected[p].first);
+            MY_REQUIRE_EQUAL(expected[p].first, geq_enum.docid(),
+                             "term = " << term << " p = " << p);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merged_freq_index)
+{
+    test_merged_freq_index(30, 40);
+    test_merged_freq_index(40, 30);
+
+    quasi_succinct::global_parameters flat_params;
+    flat_params.flat_endpoints = 1;
+    test_merged_freq_index(30, 30, flat_params);
+
+    quasi_succinct::global_parameters headers_params;
+    headers_params.list_headers = 1;
+    test_merged_freq_index(30, 30, headers_params);
+}
+
+BOOST_AUTO_TEST_CASE(global_parameters_format)
+{
+    using quasi_succinct::global_parameters;
+
+    // parameters serialized before the format tag
+    const char legacy[] = {10, 7, 11, 6, 5};
+    global_parameters legacy_params;
+    BOOST_REQUIRE_EQUAL(sizeof(legacy),
+                        succinct::mapper::map(legacy_params, legacy));
+    BOOST_REQUIRE_EQUAL(10, legacy_params.ef_log_sampling0);
+    BOOST_REQUIRE_EQUAL(7, legacy_params.ef_log_sampling1);
+    BOOST_REQUIRE_EQUAL(11, legacy_params.rb_log_rank1_sampling);
+    BOOST_REQUIRE_EQUAL(6, legacy_params.rb_log_sampling1);
+    BOOST_REQUIRE_EQUAL(5, legacy_params.log_partition_size);
+    BOOST_REQUIRE_EQUAL(0, legacy_params.flat_endpoints);
+    BOOST_REQUIRE_EQUAL(0, legacy_params.list_headers);
+
+    global_parameters params;
+    params.flat_endpoints = 1;
+    params.list_headers = 1;
+    const char* filename = "temp_global_parameters.bin";
+    BOOST_REQUIRE_EQUAL(8U, succinct::mapper::freeze(params, filename));
+    std::string data;
+    {
+        std::ifstream is(filename, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    }
+    std::remove(filename);
+    BOOST_REQUIRE_EQUAL(8U, data.size());
+
+    global_parameters mapped;
+    mapped.flat_endpoints = 0;
+    BOOST_REQUIRE_EQUAL(data.size(), succinct::mapper::map(mapped, data.data()));
+    BOOST_REQUIRE_EQUAL(1, mapped.flat_endpoints);
+    BOOST_REQUIRE_EQUAL(1, mapped.list_headers);
 }
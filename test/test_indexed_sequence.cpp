@@ -19,3 +19,26 @@ BOOST_AUTO_TEST_CASE(indexed_sequence)
         test_sequence(quasi_succinct::indexed_sequence(), params, universe, seq);
     }
 }
+
+BOOST_AUTO_TEST_CASE(indexed_sequence_space_time)
+{
+    using quasi_succinct::indexed_sequence;
+    quasi_succinct::global_parameters params;
+    quasi_succinct::access_time_model model;
+
+    for (uint64_t universe: { 10000, 20000, 30000, 50000, 100000 }) {
+        uint64_t n = 10000;
+        uint64_t cost;
+        // with lambda = 0 the choice minimizes space
+        auto type = indexed_sequence::choose_type(params, universe, n, model, 0, cost);
+        BOOST_REQUIRE_EQUAL(indexed_sequence::bitsize(params, universe, n), cost);
+
+        // with a much slower ef, a positive lambda picks rb
+        model.ef_ns = 100;
+        auto fast_type = indexed_sequence::choose_type(params, universe, n, model, 1, cost);
+        if (type != indexed_sequence::all_ones) {
+            BOOST_REQUIRE_EQUAL(indexed_sequence::ranked_bitvector, fast_type);
+        }
+        model.ef_ns = quasi_succinct::access_time_model().ef_ns;
+    }
+}
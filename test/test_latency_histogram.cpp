@@ -0,0 +1,49 @@
+#define BOOST_TEST_MODULE latency_histogram
+
+#include "succinct/test_common.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "latency_histogram.hpp"
+
+BOOST_AUTO_TEST_CASE(latency_histogram)
+{
+    quasi_succinct::latency_histogram hist;
+    BOOST_REQUIRE_EQUAL(0U, hist.count());
+    BOOST_REQUIRE_EQUAL(0, hist.quantile(0.99));
+
+    // values spanning several orders of magnitude, from 10ns to 1s
+    std::vector<double> values;
+    srand(42);
+    for (size_t i = 0; i < 100000; ++i) {
+        double v = 0.01 * std::pow(10.0, 8.0 * double(rand()) / RAND_MAX);
+        values.push_back(v);
+        hist.add(v);
+    }
+    std::sort(values.begin(), values.end());
+
+    BOOST_REQUIRE_EQUAL(values.size(), hist.count());
+    BOOST_REQUIRE_EQUAL(values.front(), hist.min());
+    BOOST_REQUIRE_EQUAL(values.back(), hist.max());
+    BOOST_REQUIRE_EQUAL(values.back(), hist.quantile(1));
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    BOOST_REQUIRE_CLOSE(mean, hist.mean(), 1e-6);
+
+    // the quantiles are within the bucket resolution of the exact ones;
+    // the values are truncated to nanoseconds, hence the absolute slack
+    for (double q: {0.01, 0.5, 0.9, 0.95, 0.99, 0.999, 0.9999}) {
+        double exact = values[size_t(std::ceil(q * values.size())) - 1];
+        double approx = hist.quantile(q);
+        BOOST_REQUIRE_MESSAGE(approx >= exact - 0.001 &&
+                              approx <= exact * (1 + 1.0 / 64) + 0.001,
+                              "q = " << q << ": exact " << exact
+                              << ", histogram " << approx);
+    }
+
+    hist.clear();
+    BOOST_REQUIRE_EQUAL(0U, hist.count());
+    hist.add(3);
+    BOOST_REQUIRE_EQUAL(3, hist.quantile(0.5));
+}
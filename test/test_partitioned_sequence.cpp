@@ -39,6 +39,23 @@ namespace quasi_succinct {
                 }
             }
         }
+
+        template <typename Enumerator>
+        static void test_partition_view(Enumerator& r, std::vector<uint64_t> const& seq)
+        {
+            for (size_t i = 0; i < seq.size(); ++i) {
+                r.move(i);
+                auto view = r.partition();
+                BOOST_REQUIRE(view.begin <= i && i < view.end);
+                BOOST_REQUIRE(view.base <= seq[i] && seq[i] <= view.upper_bound);
+                if (i == view.begin &&
+                    view.type == quasi_succinct::indexed_sequence::ranked_bitvector) {
+                    for (uint64_t j = view.begin; j < view.end; ++j) {
+                        BOOST_REQUIRE((*view.bv)[view.bitmap_offset + seq[j] - view.base]);
+                    }
+                }
+            }
+        }
     };
 }
 
@@ -58,6 +75,20 @@ void test_partitioned_sequence(uint64_t universe,
     test_sequence(r, seq);
 }
 
+void test_indexed_partition_view(uint64_t universe,
+                                 std::vector<uint64_t> const& seq)
+{
+    quasi_succinct::global_parameters params;
+    typedef quasi_succinct::partitioned_sequence<> sequence_type;
+
+    succinct::bit_vector_builder bvb;
+    sequence_type::write(bvb, seq.begin(), universe, seq.size(), params);
+    succinct::bit_vector bv(&bvb);
+
+    sequence_type::enumerator r(bv, 0, universe, seq.size(), params);
+    quasi_succinct::partitioned_sequence_test::test_partition_view(r, seq);
+}
+
 BOOST_AUTO_TEST_CASE(partitioned_sequence)
 {
     using quasi_succinct::indexed_sequence;
@@ -96,6 +127,7 @@ BOOST_AUTO_TEST_CASE(partitioned_sequence)
         auto seq = random_sequence(universe, n, true);
         test_partitioned_sequence<indexed_sequence>(universe, seq);
         test_partitioned_sequence<strict_sequence>(universe, seq);
+        test_indexed_partition_view(universe, seq);
     }
 
     // test also short (singleton partition) sequences with large universe
@@ -109,3 +141,49 @@ BOOST_AUTO_TEST_CASE(partitioned_sequence)
     }
 
 }
+
+BOOST_AUTO_TEST_CASE(exact_partition)
+{
+    using quasi_succinct::partitioned_sequence;
+    using quasi_succinct::optimal_partition;
+    quasi_succinct::global_parameters params;
+
+    std::vector<double> avg_gaps = { 1.1, 2.5, 10 };
+    for (auto avg_gap: avg_gaps) {
+        uint64_t n = 3000;
+        uint64_t universe = uint64_t(n * avg_gap);
+        // mix dense and sparse stretches so that there are partitions
+        auto seq = random_sequence(universe, n, true);
+        for (size_t i = n / 2; i < n; ++i) {
+            seq[i] = seq[n / 2 - 1] + 1 + (seq[i] - seq[n / 2 - 1] - 1) * 20;
+        }
+        universe = seq.back() + 1;
+
+        auto approx = partitioned_sequence<>::compute_partition(seq.begin(), universe, n,
+                                                                params, false);
+        auto exact = partitioned_sequence<>::compute_partition(seq.begin(), universe, n,
+                                                               params, true);
+        BOOST_REQUIRE(exact.cost_opt <= approx.cost_opt);
+        BOOST_REQUIRE_EQUAL(n, exact.partition.back());
+
+        // the cost is the one of the returned partition
+        auto cost_fun = [&](uint64_t universe, uint64_t n) {
+            return quasi_succinct::indexed_sequence::bitsize(params, universe, n)
+                + quasi_succinct::configuration::get().fix_cost;
+        };
+        uint64_t cost = 0, begin = 0;
+        for (auto end: exact.partition) {
+            uint64_t base = begin ? seq[begin - 1] + 1 : seq[0];
+            cost += cost_fun(seq[end - 1] - base + 1, end - begin);
+            begin = end;
+        }
+        BOOST_REQUIRE_EQUAL(cost, exact.cost_opt);
+
+        // the result does not depend on the number of threads
+        for (size_t threads: { 2, 3 }) {
+            optimal_partition parallel(seq.begin(), universe, n, cost_fun, threads);
+            BOOST_REQUIRE_EQUAL(exact.cost_opt, parallel.cost_opt);
+            BOOST_REQUIRE(exact.partition == parallel.partition);
+        }
+    }
+}
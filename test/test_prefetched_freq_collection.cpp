@@ -0,0 +1,52 @@
+#define BOOST_TEST_MODULE prefetched_freq_collection
+
+#include "succinct/test_common.hpp"
+
+#include <cstdlib>
+
+#include "binary_freq_collection.hpp"
+#include "prefetched_freq_collection.hpp"
+#include "index_types.hpp"
+
+BOOST_AUTO_TEST_CASE(prefetched_freq_collection)
+{
+    using namespace quasi_succinct;
+    // small chunks, so that many lists span several of them; must be set
+    // before the configuration is first read
+    setenv("QS_PREFETCH_CHUNK", "4096", 1);
+    setenv("QS_PREFETCH_AHEAD", "3", 1);
+    BOOST_REQUIRE_EQUAL(4096U, configuration::get().prefetch_chunk);
+
+    binary_freq_collection input("test_data/test_collection"); // XXX path should be absolute
+    quasi_succinct::prefetched_freq_collection coll("test_data/test_collection");
+    BOOST_REQUIRE_EQUAL(input.num_docs(), coll.num_docs());
+
+    // the builder reads the lists after the iterator has moved on
+    global_parameters params;
+    opt_index::builder builder(coll.num_docs(), params);
+    auto it = coll.begin();
+    for (auto const& plist: input) {
+        BOOST_REQUIRE(it != coll.end());
+        BOOST_REQUIRE_EQUAL(plist.docs.size(), it->docs.size());
+        BOOST_REQUIRE(std::equal(plist.docs.begin(), plist.docs.end(), it->docs.begin()));
+        BOOST_REQUIRE(std::equal(plist.freqs.begin(), plist.freqs.end(), it->freqs.begin()));
+        uint64_t freqs_sum = std::accumulate(it->freqs.begin(),
+                                             it->freqs.end(), uint64_t(0));
+        builder.add_posting_list(it->docs.size(), it->docs.begin(),
+                                 it->freqs.begin(), freqs_sum);
+        ++it;
+    }
+    BOOST_REQUIRE(it == coll.end());
+    opt_index index;
+    builder.build(index);
+
+    size_t term = 0;
+    for (auto const& plist: input) {
+        auto e = index[term++];
+        BOOST_REQUIRE_EQUAL(plist.docs.size(), e.size());
+        for (size_t i = 0; i < e.size(); ++i, e.next()) {
+            MY_REQUIRE_EQUAL(*(plist.docs.begin() + i), e.docid(), "i = " << i);
+            MY_REQUIRE_EQUAL(*(plist.freqs.begin() + i), e.freq(), "i = " << i);
+        }
+    }
+}
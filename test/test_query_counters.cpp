@@ -0,0 +1,108 @@
+#define BOOST_TEST_MODULE query_counters
+// the counters are compiled in only in this test
+#define QS_ENABLE_COUNTERS
+
+#include "succinct/test_common.hpp"
+
+#include "index_types.hpp"
+#include "queries.hpp"
+#include "query_counters.hpp"
+
+namespace {
+
+    template <typename IndexType>
+    void build_index(quasi_succinct::binary_freq_collection const& collection,
+                     IndexType& index)
+    {
+        quasi_succinct::global_parameters params;
+        typename IndexType::builder builder(collection.num_docs(), params);
+        for (auto const& plist: collection) {
+            uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                                 plist.freqs.end(), uint64_t(0));
+            builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                     plist.freqs.begin(), freqs_sum);
+        }
+        builder.build(index);
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE(query_counters)
+{
+    using namespace quasi_succinct;
+    binary_freq_collection collection("test_data/test_collection"); // XXX path should be absolute
+    binary_collection document_sizes("test_data/test_collection.sizes");
+    wand_data<> wdata(document_sizes.begin()->begin(), collection.num_docs(), collection);
+
+    std::vector<term_id_vec> queries;
+    term_id_vec q;
+    std::ifstream qfile("test_data/queries");
+    while (read_query(q, qfile)) queries.push_back(q);
+
+    opt_index opt;
+    build_index(collection, opt);
+    block_optpfor_index block;
+    build_index(collection, block);
+
+    quasi_succinct::query_counters& counters = thread_query_counters();
+    counters.reset();
+    and_query<true> and_q;
+    for (auto const& query: queries) and_q(opt, query);
+    BOOST_REQUIRE(counters.next_geq > 0);
+    BOOST_REQUIRE(counters.ef_skips > 0);
+    BOOST_REQUIRE_EQUAL(0U, counters.block_decodes);
+    BOOST_REQUIRE_EQUAL(0U, counters.scored_docs);
+
+    counters.reset();
+    or_query<true> or_freq_q;
+    for (auto const& query: queries) or_freq_q(block, query);
+    BOOST_REQUIRE(counters.next > 0);
+    BOOST_REQUIRE(counters.block_decodes > 0);
+    BOOST_REQUIRE_EQUAL(0U, counters.partition_switches);
+
+    // every document of the union is scored by ranked_or
+    counters.reset();
+    ranked_or_query ranked_or_q(wdata, 10);
+    or_query<false> or_q;
+    uint64_t or_results = 0;
+    for (auto const& query: queries) {
+        ranked_or_q(opt, query);
+        or_results += or_q(opt, query);
+    }
+    BOOST_REQUIRE_EQUAL(or_results, counters.scored_docs);
+    BOOST_REQUIRE_EQUAL(0U, counters.pruned_docs);
+
+    // the dynamic pruning scores fewer documents
+    counters.reset();
+    wand_query wand_q(wdata, 10);
+    for (auto const& query: queries) wand_q(opt, query);
+    BOOST_REQUIRE(counters.scored_docs < or_results);
+    BOOST_REQUIRE(counters.pruned_docs > 0);
+
+    counters.reset();
+    maxscore_query maxscore_q(wdata, 10);
+    for (auto const& query: queries) maxscore_q(opt, query);
+    BOOST_REQUIRE(counters.scored_docs < or_results);
+    // each candidate is counted once
+    BOOST_REQUIRE(counters.scored_docs + counters.pruned_docs <= or_results);
+
+    // long lists are split in several partitions
+    uint64_t num_docs = 1 << 20;
+    std::vector<uint64_t> docs, freqs;
+    for (uint64_t d = 0; d < num_docs; ++d) {
+        if (d % (1 + (d >> 16)) == 0) {
+            docs.push_back(d);
+            freqs.push_back(1);
+        }
+    }
+    global_parameters params;
+    opt_index::builder builder(num_docs, params);
+    builder.add_posting_list(docs.size(), docs.begin(), freqs.begin(), docs.size());
+    opt_index long_opt;
+    builder.build(long_opt);
+    counters.reset();
+    auto e = long_opt[0];
+    for (size_t i = 0; i < e.size(); ++i) e.next();
+    BOOST_REQUIRE_EQUAL(docs.size(), counters.next);
+    BOOST_REQUIRE(counters.partition_switches > 1);
+}
@@ -5,6 +5,8 @@
 
 #include "index_types.hpp"
 #include "queries.hpp"
+#include "enumerator_cache.hpp"
+#include "decoded_list_cache.hpp"
 
 namespace quasi_succinct { namespace test {
 
@@ -39,9 +41,16 @@ namespace quasi_succinct { namespace test {
         wand_data<> wdata;
 
         template <typename QueryOp>
-        void test_against_or(QueryOp& op_q) const
+        void test_against_or(QueryOp& op_q, uint64_t k = 10) const
         {
-            ranked_or_query or_q(wdata, 10);
+            test_against_or(op_q, wdata, k);
+        }
+
+        // op_q must use the same wand data wd
+        template <typename QueryOp>
+        void test_against_or(QueryOp& op_q, wand_data<> const& wd, uint64_t k) const
+        {
+            ranked_or_query or_q(wd, k);
 
             for (auto const& q: queries) {
                 or_q(index, q);
@@ -72,3 +81,336 @@ BOOST_FIXTURE_TEST_CASE(maxscore,
     quasi_succinct::maxscore_query maxscore_q(wdata, 10);
     test_against_or(maxscore_q);
 }
+
+BOOST_FIXTURE_TEST_CASE(wand_primed,
+                        quasi_succinct::test::index_initialization)
+{
+    for (uint64_t k: {10, 1000}) {
+        quasi_succinct::wand_query wand_q(wdata, k, true);
+        test_against_or(wand_q, k);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(maxscore_primed,
+                        quasi_succinct::test::index_initialization)
+{
+    for (uint64_t k: {10, 1000}) {
+        quasi_succinct::maxscore_query maxscore_q(wdata, k, true);
+        test_against_or(maxscore_q, k);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(buffered_queue,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    for (uint64_t k: {10, 1000}) {
+        basic_ranked_or_query<buffered_topk_queue> or_q(wdata, k);
+        test_against_or(or_q, k);
+        basic_ranked_and_query<buffered_topk_queue> and_q(wdata, k);
+        basic_ranked_and_query<topk_queue> heap_and_q(wdata, k);
+        for (auto const& q: queries) {
+            and_q(index, q);
+            heap_and_q(index, q);
+            BOOST_REQUIRE(and_q.topk() == heap_and_q.topk());
+        }
+        basic_wand_query<buffered_topk_queue> wand_q(wdata, k, true);
+        test_against_or(wand_q, k);
+        basic_maxscore_query<buffered_topk_queue> maxscore_q(wdata, k, true);
+        test_against_or(maxscore_q, k);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(batch,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    enumerator_cache<index_type> cache(index, 16);
+    wand_query wand_q(wdata, 10);
+    ranked_or_query or_q(wdata, 10);
+    and_query<false> and_q;
+
+    for (size_t b = 0; b < queries.size(); b += 50) {
+        std::vector<term_id_vec> batch(queries.begin() + b,
+                                       queries.begin() + std::min(b + 50, queries.size()));
+        batch_query(cache, wand_q, batch,
+                    [&](size_t i, uint64_t) {
+                        or_q(index, batch[i]);
+                        BOOST_REQUIRE_EQUAL(or_q.topk().size(), wand_q.topk().size());
+                        for (size_t r = 0; r < or_q.topk().size(); ++r) {
+                            BOOST_REQUIRE_CLOSE(or_q.topk()[r], wand_q.topk()[r], 0.1);
+                        }
+                    });
+        batch_query(cache, and_q, batch,
+                    [&](size_t i, uint64_t results) {
+                        BOOST_REQUIRE_EQUAL(and_q(index, batch[i]), results);
+                    });
+    }
+    BOOST_REQUIRE(cache.hits() > 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(bitmap_and,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    // the partitioned index is the one with bitmap partitions
+    opt_index::builder builder(collection.num_docs(), params);
+    for (auto const& plist: collection) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                             plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                 plist.freqs.begin(), freqs_sum);
+    }
+    opt_index opt;
+    builder.build(opt);
+
+    and_query<false> and_q;
+    bitmap_and_query<false> bitmap_and_q;
+    bitmap_and_query<true> bitmap_and_freq_q;
+    for (auto const& q: queries) {
+        uint64_t results = and_q(index, q);
+        BOOST_REQUIRE_EQUAL(results, bitmap_and_q(opt, q));
+        BOOST_REQUIRE_EQUAL(results, bitmap_and_freq_q(opt, q));
+        BOOST_REQUIRE_EQUAL(results, bitmap_and_q(index, q));
+    }
+
+    // only the partitions of indexed_sequence have a bitmap view
+    typedef freq_index<partitioned_sequence<strict_sequence>,
+                       positive_sequence<>> strict_partitioned_index;
+    static_assert(has_partition_view<opt_index::document_enumerator>::value,
+                  "opt_index has partition views");
+    static_assert(!has_partition_view<strict_partitioned_index::document_enumerator>::value,
+                  "partitioned_sequence<strict_sequence> has no partition views");
+    static_assert(!has_partition_view<single_index::document_enumerator>::value,
+                  "single_index has no partition views");
+
+    // dense lists, where most partitions are bitmaps
+    uint64_t num_docs = 100000;
+    size_t num_terms = 6;
+    // the builder reads the lists asynchronously, keep them alive
+    std::vector<std::vector<uint64_t>> docs(num_terms), freqs(num_terms);
+    opt_index::builder dense_builder(num_docs, params);
+    for (size_t t = 0; t < num_terms; ++t) {
+        for (uint64_t d = 0; d < num_docs; ++d) {
+            // alternate dense and sparse stretches to mix partition types
+            uint64_t density = ((d / 5000) % 3) ? 2 + t % 3 : 50;
+            if (rand() % density == 0) {
+                docs[t].push_back(d);
+                freqs[t].push_back(1 + rand() % 3);
+            }
+        }
+        dense_builder.add_posting_list(docs[t].size(), docs[t].begin(), freqs[t].begin(),
+                                       std::accumulate(freqs[t].begin(), freqs[t].end(),
+                                                       uint64_t(0)));
+    }
+    opt_index dense;
+    dense_builder.build(dense);
+
+    for (term_id_type t1 = 0; t1 < num_terms; ++t1) {
+        for (term_id_type t2 = t1 + 1; t2 < num_terms; ++t2) {
+            for (term_id_type t3 = t2; t3 < num_terms; ++t3) {
+                term_id_vec q = {t1, t2, t3};
+                uint64_t results = and_q(dense, q);
+                BOOST_REQUIRE_EQUAL(results, bitmap_and_q(dense, q));
+                BOOST_REQUIRE_EQUAL(results, bitmap_and_freq_q(dense, q));
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(deleted_documents,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    std::vector<binary_freq_collection::sequence> lists(collection.begin(),
+                                                        collection.end());
+    // with few deletions the primed thresholds are still used
+    for (uint64_t one_in: {10, 1000}) {
+        std::vector<uint64_t> docids;
+        for (uint64_t docid = 0; docid < collection.num_docs(); ++docid) {
+            if (rand() % one_in == 0) docids.push_back(docid);
+        }
+        quasi_succinct::deleted_docs deleted(collection.num_docs(), docids.begin(), docids.end());
+        BOOST_REQUIRE_EQUAL(docids.size(), deleted.num_deleted());
+
+        and_query<false> and_q(&deleted);
+        bitmap_and_query<true> bitmap_and_q(&deleted);
+        or_query<true> or_q(&deleted);
+        ranked_and_query all_and_q(wdata, collection.num_docs(), &deleted);
+        for (auto q: queries) {
+            if (q.empty()) continue;
+            remove_duplicate_terms(q);
+            std::vector<uint64_t> and_docs(lists[q[0]].docs.begin(), lists[q[0]].docs.end());
+            std::vector<uint64_t> or_docs;
+            for (auto term: q) {
+                std::vector<uint64_t> list(lists[term].docs.begin(), lists[term].docs.end());
+                std::vector<uint64_t> tmp;
+                std::set_intersection(and_docs.begin(), and_docs.end(),
+                                      list.begin(), list.end(), std::back_inserter(tmp));
+                and_docs.swap(tmp);
+                tmp.clear();
+                std::set_union(or_docs.begin(), or_docs.end(),
+                               list.begin(), list.end(), std::back_inserter(tmp));
+                or_docs.swap(tmp);
+            }
+            auto live = [&](std::vector<uint64_t> const& docs) {
+                return uint64_t(std::count_if(docs.begin(), docs.end(), [&](uint64_t docid) {
+                            return !deleted.contains(docid);
+                        }));
+            };
+            BOOST_REQUIRE_EQUAL(live(and_docs), and_q(index, q));
+            BOOST_REQUIRE_EQUAL(live(and_docs), bitmap_and_q(index, q));
+            BOOST_REQUIRE_EQUAL(live(or_docs), or_q(index, q));
+            BOOST_REQUIRE_EQUAL(live(and_docs), all_and_q(index, q));
+        }
+
+        // the threshold priming must account for the deleted documents
+        for (uint64_t k: {10, 1000}) {
+            ranked_or_query or_ranked_q(wdata, k, &deleted);
+            wand_query wand_q(wdata, k, true, &deleted);
+            maxscore_query maxscore_q(wdata, k, true, &deleted);
+            for (auto const& q: queries) {
+                or_ranked_q(index, q);
+                wand_q(index, q);
+                maxscore_q(index, q);
+                BOOST_REQUIRE_EQUAL(or_ranked_q.topk().size(), wand_q.topk().size());
+                BOOST_REQUIRE_EQUAL(or_ranked_q.topk().size(), maxscore_q.topk().size());
+                for (size_t i = 0; i < or_ranked_q.topk().size(); ++i) {
+                    BOOST_REQUIRE_CLOSE(or_ranked_q.topk()[i], wand_q.topk()[i], 0.1);
+                    BOOST_REQUIRE_CLOSE(or_ranked_q.topk()[i], maxscore_q.topk()[i], 0.1);
+                }
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(wand_data_from_index,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    block_optpfor_index::builder builder(collection.num_docs(), params);
+    for (auto const& plist: collection) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                             plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                 plist.freqs.begin(), freqs_sum);
+    }
+    block_optpfor_index block_index;
+    builder.build(block_index);
+
+    // the weights must be exactly those computed from the collection
+    wand_data<> index_wdata(document_sizes.begin()->begin(), index.num_docs(), index);
+    wand_data<> block_wdata(document_sizes.begin()->begin(), block_index.num_docs(), block_index);
+    for (size_t term = 0; term < index.size(); ++term) {
+        BOOST_REQUIRE_EQUAL(wdata.max_term_weight(term), index_wdata.max_term_weight(term));
+        BOOST_REQUIRE_EQUAL(wdata.max_term_weight(term), block_wdata.max_term_weight(term));
+        for (uint64_t k: wand_data<>::default_threshold_ks()) {
+            BOOST_REQUIRE_EQUAL(wdata.kth_term_weight(term, k),
+                                index_wdata.kth_term_weight(term, k));
+            BOOST_REQUIRE_EQUAL(wdata.kth_term_weight(term, k),
+                                block_wdata.kth_term_weight(term, k));
+        }
+    }
+    for (uint64_t docid = 0; docid < index.num_docs(); ++docid) {
+        BOOST_REQUIRE_EQUAL(wdata.norm_len(docid), index_wdata.norm_len(docid));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(quantized_norm_lens,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    for (size_t bits: {8, 16}) {
+        wand_data<> qwdata(document_sizes.begin()->begin(), collection.num_docs(),
+                           collection, wand_data<>::default_threshold_ks(), bits);
+        BOOST_REQUIRE_EQUAL(bits, qwdata.norm_len_bits());
+
+        // the max weights are computed from the quantized norm lens, so the
+        // dynamic pruning must still be exact
+        for (uint64_t k: {10, 1000}) {
+            wand_query wand_q(qwdata, k, true);
+            test_against_or(wand_q, qwdata, k);
+            maxscore_query maxscore_q(qwdata, k, true);
+            test_against_or(maxscore_q, qwdata, k);
+        }
+
+        // relative difference of the top-k scores from the exact ones
+        ranked_or_query exact_q(wdata, 10);
+        ranked_or_query quantized_q(qwdata, 10);
+        double max_diff = 0;
+        for (auto const& q: queries) {
+            exact_q(index, q);
+            quantized_q(index, q);
+            BOOST_REQUIRE_EQUAL(exact_q.topk().size(), quantized_q.topk().size());
+            for (size_t i = 0; i < exact_q.topk().size(); ++i) {
+                max_diff = std::max(max_diff, std::abs(double(exact_q.topk()[i]) -
+                                                       quantized_q.topk()[i]) /
+                                    exact_q.topk()[i]);
+            }
+        }
+        BOOST_TEST_MESSAGE(bits << " bits norm lens, max top-10 score difference " << max_diff);
+        BOOST_REQUIRE(max_diff < (bits == 8 ? 0.05 : 0.001));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(decoded_cache,
+                        quasi_succinct::test::index_initialization)
+{
+    using namespace quasi_succinct;
+    // a budget small enough that only part of the query terms are cached
+    quasi_succinct::decoded_list_cache<index_type> cache(index, 1 << 12);
+    cache.prepare(queries);
+    BOOST_REQUIRE(cache.cached_terms() > 0);
+    BOOST_REQUIRE(cache.cached_bytes() <= 1 << 12);
+
+    and_query<true> and_q;
+    or_query<true> or_q;
+    ranked_and_query ranked_and_q(wdata, 10);
+    wand_query wand_q(wdata, 10);
+    maxscore_query maxscore_q(wdata, 10);
+    auto check_queries = [&](std::vector<term_id_vec> const& qs) {
+        for (auto const& q: qs) {
+            BOOST_REQUIRE_EQUAL(and_q(index, q), and_q(cache, q));
+            BOOST_REQUIRE_EQUAL(or_q(index, q), or_q(cache, q));
+            ranked_and_q(index, q);
+            auto topk = ranked_and_q.topk();
+            ranked_and_q(cache, q);
+            BOOST_REQUIRE(topk == ranked_and_q.topk());
+            wand_q(index, q);
+            topk = wand_q.topk();
+            wand_q(cache, q);
+            BOOST_REQUIRE(topk == wand_q.topk());
+            // maxscore adds up the scores in a different order
+            maxscore_q(cache, q);
+            BOOST_REQUIRE_EQUAL(topk.size(), maxscore_q.topk().size());
+            for (size_t i = 0; i < topk.size(); ++i) {
+                BOOST_REQUIRE_CLOSE(topk[i], maxscore_q.topk()[i], 0.1); // tolerance is % relative
+            }
+        }
+    };
+    check_queries(queries);
+    BOOST_REQUIRE(cache.hits() > 0);
+    BOOST_REQUIRE(cache.misses() > 0);
+
+    // the cache is queried by several threads while it is replaced
+    std::vector<term_id_vec> first_half(queries.begin(), queries.begin() + queries.size() / 2);
+    std::vector<term_id_vec> second_half(queries.begin() + queries.size() / 2, queries.end());
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> expected, results(2 * queries.size());
+    for (auto const& q: queries) expected.push_back(and_query<true>()(index, q));
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&, t] {
+                and_query<true> thread_and_q;
+                for (size_t i = 0; i < queries.size(); ++i) {
+                    results[t * queries.size() + i] = thread_and_q(cache, queries[i]);
+                }
+            });
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        cache.prepare(i % 2 ? first_half : second_half);
+    }
+    for (auto& t: threads) t.join();
+    for (size_t i = 0; i < results.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(expected[i % queries.size()], results[i]);
+    }
+}
@@ -0,0 +1,193 @@
+#define BOOST_TEST_MODULE segmented_index
+
+#include "succinct/test_common.hpp"
+
+#include "index_types.hpp"
+#include "queries.hpp"
+#include "segmented_index.hpp"
+
+namespace quasi_succinct { namespace test {
+
+    typedef segmented_index<opt_index> segmented_type;
+
+    struct collection_initialization {
+
+        collection_initialization()
+            : collection("test_data/test_collection") // XXX path should be absolute
+            , lists(collection.begin(), collection.end())
+            , documents(collection.num_docs())
+        {
+            single_index::builder builder(collection.num_docs(), params);
+            uint64_t term = 0;
+            for (auto const& plist: collection) {
+                uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                                     plist.freqs.end(), uint64_t(0));
+                builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                         plist.freqs.begin(), freqs_sum);
+                auto freq_it = plist.freqs.begin();
+                for (auto docid: plist.docs) {
+                    documents[docid].emplace_back(term, *freq_it++);
+                }
+                term += 1;
+            }
+            builder.build(index);
+
+            term_id_vec q;
+            std::ifstream qfile("test_data/queries");
+            while (read_query(q, qfile)) queries.push_back(q);
+        }
+
+        // checks the lists of a sample of the terms, restricted to the
+        // documents before num_docs, repeated every period documents
+        template <typename Snapshot>
+        void check_lists(Snapshot const& snap, uint64_t num_docs, uint64_t period)
+        {
+            BOOST_REQUIRE_EQUAL(num_docs, snap.num_docs());
+            for (uint64_t term = 0; term < lists.size(); term += 97) {
+                std::vector<std::pair<uint64_t, uint64_t>> expected;
+                auto const& plist = lists[term];
+                for (uint64_t base = 0; base < num_docs; base += period) {
+                    auto freq_it = plist.freqs.begin();
+                    for (auto docid: plist.docs) {
+                        if (base + docid >= num_docs) break;
+                        expected.emplace_back(base + docid, *freq_it++);
+                    }
+                }
+
+                auto e = snap[term];
+                BOOST_REQUIRE_EQUAL(expected.size(), e.size());
+                for (auto const& posting: expected) {
+                    MY_REQUIRE_EQUAL(posting.first, e.docid(), "term = " << term);
+                    MY_REQUIRE_EQUAL(posting.second, e.freq(), "term = " << term);
+                    e.next();
+                }
+                BOOST_REQUIRE_EQUAL(num_docs, e.docid());
+
+                auto e_geq = snap[term];
+                for (size_t i = 0; i < expected.size(); i += 3) {
+                    e_geq.next_geq(expected[i].first);
+                    MY_REQUIRE_EQUAL(expected[i].first, e_geq.docid(), "term = " << term);
+                    e_geq.next_geq(expected[i].first + 1);
+                    uint64_t next = i + 1 < expected.size() ? expected[i + 1].first : num_docs;
+                    MY_REQUIRE_EQUAL(next, e_geq.docid(), "term = " << term);
+                }
+            }
+        }
+
+        template <typename Snapshot>
+        void check_queries(Snapshot const& snap)
+        {
+            for (auto const& q: queries) {
+                MY_REQUIRE_EQUAL(and_query<true>()(index, q), and_query<true>()(snap, q),
+                                 "and");
+                MY_REQUIRE_EQUAL(or_query<false>()(index, q), or_query<false>()(snap, q),
+                                 "or");
+            }
+        }
+
+        global_parameters params;
+        binary_freq_collection collection;
+        std::vector<binary_freq_collection::sequence> lists;
+        std::vector<segmented_type::document_terms> documents;
+        single_index index;
+        std::vector<term_id_vec> queries;
+    };
+
+} }
+
+BOOST_FIXTURE_TEST_CASE(segmented_index_updates,
+                        quasi_succinct::test::collection_initialization)
+{
+    uint64_t num_docs = collection.num_docs();
+    quasi_succinct::test::segmented_type segmented(params, num_docs / 10 + 1);
+
+    for (uint64_t docid = 0; docid < num_docs / 2; ++docid) {
+        BOOST_REQUIRE_EQUAL(docid, segmented.add_document(documents[docid]));
+    }
+    auto half = segmented.get_snapshot();
+    check_lists(*half, num_docs / 2, num_docs);
+
+    for (uint64_t docid = num_docs / 2; docid < num_docs; ++docid) {
+        segmented.add_document(documents[docid]);
+    }
+    auto full = segmented.get_snapshot();
+
+    // the snapshots do not change while the segments are merged
+    check_lists(*half, num_docs / 2, num_docs);
+    check_lists(*full, num_docs, num_docs);
+    check_queries(*full);
+
+    segmented.flush();
+    segmented.wait_merges();
+    auto merged = segmented.get_snapshot();
+    BOOST_REQUIRE(merged->num_segments() <= 4);
+    check_lists(*merged, num_docs, num_docs);
+    check_queries(*merged);
+    check_lists(*half, num_docs / 2, num_docs);
+}
+
+BOOST_FIXTURE_TEST_CASE(segmented_index_add_segment,
+                        quasi_succinct::test::collection_initialization)
+{
+    uint64_t num_docs = collection.num_docs();
+    using quasi_succinct::opt_index;
+    quasi_succinct::test::segmented_type segmented(params, num_docs / 3 + 1);
+
+    auto base = std::make_shared<opt_index>();
+    opt_index::builder builder(num_docs, params);
+    for (auto const& plist: collection) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                             plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                 plist.freqs.begin(), freqs_sum);
+    }
+    builder.build(*base);
+    segmented.add_segment(base);
+    check_lists(*segmented.get_snapshot(), num_docs, num_docs);
+
+    // the new documents get docids after the segment
+    for (uint64_t docid = 0; docid < num_docs; ++docid) {
+        BOOST_REQUIRE_EQUAL(num_docs + docid, segmented.add_document(documents[docid]));
+    }
+    check_lists(*segmented.get_snapshot(), 2 * num_docs, num_docs);
+    segmented.flush();
+    segmented.wait_merges();
+    check_lists(*segmented.get_snapshot(), 2 * num_docs, num_docs);
+}
+
+BOOST_FIXTURE_TEST_CASE(segmented_index_frequent_snapshots,
+                        quasi_succinct::test::collection_initialization)
+{
+    uint64_t num_docs = collection.num_docs();
+    quasi_succinct::test::segmented_type segmented(params, num_docs + 1);
+
+    // a snapshot after each batch freezes a chunk of the delta; the
+    // enumerators taken from the first one outlive it
+    auto first = segmented.get_snapshot();
+    auto e = (*first)[0];
+    uint64_t batch = num_docs / 50 + 1;
+    for (uint64_t docid = 0; docid < num_docs; ++docid) {
+        segmented.add_document(documents[docid]);
+        if ((docid + 1) % batch == 0) {
+            auto snap = segmented.get_snapshot();
+            BOOST_REQUIRE_EQUAL(docid + 1, snap->num_docs());
+            if (docid + 1 == batch) {
+                e = (*snap)[0];
+            }
+        }
+    }
+    first.reset();
+    uint64_t expected = batch;
+    if (lists[0].docs.size() && *lists[0].docs.begin() < batch) {
+        expected = *lists[0].docs.begin();
+    }
+    BOOST_REQUIRE_EQUAL(expected, e.docid());
+    e.next_geq(batch);
+    BOOST_REQUIRE_EQUAL(batch, e.docid());
+
+    auto full = segmented.get_snapshot();
+    check_lists(*full, num_docs, num_docs);
+    check_queries(*full);
+    segmented.wait_merges();
+    check_lists(*segmented.get_snapshot(), num_docs, num_docs);
+}
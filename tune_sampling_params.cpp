@@ -0,0 +1,317 @@
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#include <succinct/mapper.hpp>
+
+#include "configuration.hpp"
+#include "index_types.hpp"
+#include "queries.hpp"
+#include "util.hpp"
+#include "wand_data.hpp"
+
+using namespace quasi_succinct;
+
+// Chooses the Elias-Fano and ranked-bitvector sampling parameters by
+// building the index over a sample of the posting lists with several
+// candidate parameters and replaying a sample of the query log on each.
+// The lists of the sampled query terms are always included, so that the
+// timings see the same lists as the real index; a stride of the remaining
+// lists is added to make the space estimate representative.
+// The query time is that of and_query; with --ranked the ranked operators
+// (ranked_and, wand, maxscore) are timed too, with a wand data computed
+// from the <basename>.sizes file over the sampled lists, since a wand data
+// file of the full collection does not match their renumbered terms.
+
+struct tuning_candidate {
+    global_parameters params;
+    uint64_t bytes;
+    double query_time;
+    bool pareto;
+};
+
+std::vector<global_parameters> candidate_params()
+{
+    // sampling of the zeros/of the universe (ef_log_sampling0,
+    // rb_log_rank1_sampling) and of the ones/of the positions
+    // (ef_log_sampling1, rb_log_sampling1) are tuned together: they are
+    // the same trade-off for the two encodings
+    std::vector<global_parameters> ret;
+    for (uint8_t log_sampling0 = 7; log_sampling0 <= 11; ++log_sampling0) {
+        for (uint8_t log_sampling1 = 6; log_sampling1 <= 10; ++log_sampling1) {
+            global_parameters params;
+            params.log_partition_size = configuration::get().log_partition_size;
+            params.space_time_lambda = configuration::get().space_time_lambda;
+            params.access_time = configuration::get().access_time;
+            params.ef_log_sampling0 = log_sampling0;
+            params.ef_log_sampling1 = log_sampling1;
+            params.rb_log_rank1_sampling = log_sampling0;
+            params.rb_log_sampling1 = log_sampling1;
+            ret.push_back(params);
+        }
+    }
+    return ret;
+}
+
+template <typename IndexType>
+void build_index(std::vector<binary_freq_collection::sequence> const& lists,
+                 uint64_t num_docs, global_parameters const& params,
+                 IndexType& index)
+{
+    typename IndexType::builder builder(num_docs, params);
+    for (auto const& plist: lists) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
+                                             plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(plist.docs.size(), plist.docs.begin(),
+                                 plist.freqs.begin(), freqs_sum);
+    }
+    builder.build(index);
+}
+
+template <typename IndexType, typename QueryOperator>
+double replay_queries(IndexType const& index, QueryOperator&& query_op,
+                      std::vector<term_id_vec> const& queries, size_t runs)
+{
+    // best of the runs, to filter out noise
+    double best = std::numeric_limits<double>::max();
+    for (size_t run = 0; run <= runs; ++run) {
+        auto tick = get_time_usecs();
+        for (auto const& query: queries) {
+            uint64_t result = query_op(index, query);
+            do_not_optimize_away(result);
+        }
+        double elapsed = get_time_usecs() - tick;
+        if (run != 0) { // first run is warmup
+            best = std::min(best, elapsed);
+        }
+    }
+    return best / queries.size();
+}
+
+template <typename IndexType>
+void tune(binary_freq_collection const& input,
+          std::string const& input_basename,
+          std::vector<term_id_vec> const& all_queries,
+          const char* output_filename,
+          double max_space_overhead,
+          bool ranked,
+          std::string const& type)
+{
+    const size_t max_queries = 1000;
+    const size_t list_stride = 100;
+    const size_t runs = 3;
+
+    std::vector<term_id_vec> queries;
+    size_t query_stride = std::max(size_t(1), all_queries.size() / max_queries);
+    for (size_t i = 0; i < all_queries.size(); i += query_stride) {
+        queries.push_back(all_queries[i]);
+    }
+
+    std::unordered_map<term_id_type, term_id_type> query_terms;
+    for (auto const& query: queries) {
+        for (auto term: query) {
+            query_terms.emplace(term, 0);
+        }
+    }
+
+    // sampled lists, renumbering the query terms
+    std::vector<binary_freq_collection::sequence> lists;
+    term_id_type term = 0;
+    for (auto const& plist: input) {
+        auto it = query_terms.find(term);
+        if (it != query_terms.end()) {
+            it->second = lists.size();
+            lists.push_back(plist);
+        } else if (term % list_stride == 0) {
+            lists.push_back(plist);
+        }
+        term += 1;
+    }
+
+    term_id_type num_terms = term;
+    std::vector<term_id_vec> sampled_queries;
+    for (auto query: queries) {
+        // drop the terms outside the collection
+        query.erase(std::remove_if(query.begin(), query.end(),
+                                   [&](term_id_type t) { return t >= num_terms; }),
+                    query.end());
+        for (auto& t: query) {
+            t = query_terms[t];
+        }
+        if (!query.empty()) sampled_queries.push_back(query);
+    }
+    queries.swap(sampled_queries);
+
+    uint64_t postings = 0;
+    for (auto const& plist: lists) {
+        postings += plist.docs.size();
+    }
+    logger() << "Tuning on " << lists.size() << " lists, " << postings
+             << " postings, " << queries.size() << " queries" << std::endl;
+    if (ranked) {
+        logger() << "Timing and_query, ranked_and_query, wand_query and maxscore_query"
+                 << std::endl;
+    } else {
+        logger() << "Timing and_query only; use --ranked to time the ranked operators"
+                 << " (ranked_and, wand, maxscore) too" << std::endl;
+    }
+
+    std::unique_ptr<binary_collection> sizes_coll;
+    if (ranked) {
+        sizes_coll.reset(new binary_collection((input_basename + ".sizes").c_str()));
+        if (sizes_coll->begin()->size() != input.num_docs()) {
+            throw std::invalid_argument("The sizes do not match the number of documents");
+        }
+    }
+
+    // the weights do not depend on the encoding, so the wand data is
+    // computed once, from the first candidate
+    std::unique_ptr<wand_data<>> wdata;
+    std::vector<tuning_candidate> candidates;
+    for (auto const& params: candidate_params()) {
+        IndexType index;
+        build_index(lists, input.num_docs(), params, index);
+
+        tuning_candidate c;
+        c.params = params;
+        c.bytes = succinct::mapper::size_of(index);
+        c.query_time =
+            replay_queries(index, and_query<false>(), queries, runs) +
+            replay_queries(index, and_query<true>(), queries, runs);
+        if (ranked) {
+            if (!wdata) {
+                wdata.reset(new wand_data<>(sizes_coll->begin()->begin(),
+                                            input.num_docs(), index));
+            }
+            c.query_time +=
+                replay_queries(index, ranked_and_query(*wdata, 10), queries, runs) +
+                replay_queries(index, wand_query(*wdata, 10), queries, runs) +
+                replay_queries(index, maxscore_query(*wdata, 10), queries, runs);
+        }
+        c.pareto = false;
+        candidates.push_back(c);
+
+        logger() << "ef_log_sampling0 = " << int(params.ef_log_sampling0)
+                 << ", ef_log_sampling1 = " << int(params.ef_log_sampling1)
+                 << ": " << c.bytes * 8.0 / postings << " bits per posting, "
+                 << c.query_time << " usecs per query" << std::endl;
+    }
+
+    // Pareto frontier: by increasing space, keep the candidates faster
+    // than all the smaller ones
+    std::sort(candidates.begin(), candidates.end(),
+              [](tuning_candidate const& lhs, tuning_candidate const& rhs) {
+                  return lhs.bytes < rhs.bytes ||
+                      (lhs.bytes == rhs.bytes && lhs.query_time < rhs.query_time);
+              });
+    double best_time = std::numeric_limits<double>::max();
+    for (auto& c: candidates) {
+        if (c.query_time < best_time) {
+            c.pareto = true;
+            best_time = c.query_time;
+        }
+    }
+
+    // the fastest Pareto-optimal candidate within the space budget
+    uint64_t max_bytes = uint64_t(candidates.front().bytes * (1 + max_space_overhead));
+    tuning_candidate const* chosen = &candidates.front();
+    for (auto const& c: candidates) {
+        if (!c.pareto) continue;
+        stats_line()
+            ("type", type)
+            ("ef_log_sampling0", int(c.params.ef_log_sampling0))
+            ("ef_log_sampling1", int(c.params.ef_log_sampling1))
+            ("rb_log_rank1_sampling", int(c.params.rb_log_rank1_sampling))
+            ("rb_log_sampling1", int(c.params.rb_log_sampling1))
+            ("bits_per_posting", c.bytes * 8.0 / postings)
+            ("query_time", c.query_time)
+            ;
+        if (c.bytes <= max_bytes && c.query_time < chosen->query_time) {
+            chosen = &c;
+        }
+    }
+
+    global_parameters params = chosen->params;
+    params.flat_endpoints = configuration::get().flat_endpoints;
+    params.list_headers = configuration::get().list_headers;
+    logger() << "Chosen parameters: "
+             << "QS_EF_LOG_SAMPLING0=" << int(params.ef_log_sampling0) << " "
+             << "QS_EF_LOG_SAMPLING1=" << int(params.ef_log_sampling1) << " "
+             << "QS_RB_LOG_RANK1_SAMPLING=" << int(params.rb_log_rank1_sampling) << " "
+             << "QS_RB_LOG_SAMPLING1=" << int(params.rb_log_sampling1) << std::endl;
+    stats_line()
+        ("type", type)
+        ("chosen", true)
+        ("ef_log_sampling0", int(params.ef_log_sampling0))
+        ("ef_log_sampling1", int(params.ef_log_sampling1))
+        ("rb_log_rank1_sampling", int(params.rb_log_rank1_sampling))
+        ("rb_log_sampling1", int(params.rb_log_sampling1))
+        ("max_space_overhead", max_space_overhead)
+        ("ranked", ranked)
+        ;
+
+    if (output_filename) {
+        logger() << "Building the full index" << std::endl;
+        std::vector<binary_freq_collection::sequence> all_lists(input.begin(), input.end());
+        IndexType index;
+        build_index(all_lists, input.num_docs(), params, index);
+        succinct::mapper::freeze(index, output_filename);
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <collection basename> <query log>"
+                  << " [<output filename>] [--max-space-overhead <ratio>] [--ranked]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    const char* input_basename = argv[2];
+    const char* queries_filename = argv[3];
+    const char* output_filename = nullptr;
+    double max_space_overhead = 0.05;
+    bool ranked = false;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max-space-overhead" && i + 1 < argc) {
+            max_space_overhead = boost::lexical_cast<double>(argv[++i]);
+        } else if (arg == "--ranked") {
+            ranked = true;
+        } else {
+            output_filename = argv[i];
+        }
+    }
+
+    binary_freq_collection input(input_basename);
+
+    std::vector<term_id_vec> queries;
+    term_id_vec q;
+    std::ifstream qfile(queries_filename);
+    while (read_query(q, qfile)) queries.push_back(q);
+
+    // block indexes have no sampling parameters
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                           \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {                     \
+            tune<BOOST_PP_CAT(T, _index)>                               \
+                (input, input_basename, queries, output_filename,       \
+                 max_space_overhead, ranked, type);                     \
+            /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, (ef)(single)(uniform)(opt));
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown or untunable type " << type << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "compact_elias_fano.hpp"
 #include "indexed_sequence.hpp"
 #include "integer_codes.hpp"
+#include "query_counters.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -272,6 +273,7 @@ namespace quasi_succinct {
             void switch_partition(uint64_t partition)
             {
                 assert(m_partitions > 1);
+                QS_COUNT(partition_switches);
 
                 uint64_t endpoint = partition
                     ? m_bv->get_bits(m_endpoints_offset +
@@ -5,8 +5,11 @@
 #include <vector>
 #include <iomanip>
 #include <locale>
+#include <memory>
+#include <iterator>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <time.h>
 
 #include "succinct/broadword.hpp"
 
@@ -44,10 +47,11 @@ namespace quasi_succinct {
         return std::cerr << ": ";
     }
 
+    // monotonic, with nanosecond resolution; only differences are meaningful
     inline double get_time_usecs() {
-        timeval tv;
-        gettimeofday(&tv, NULL);
-        return double(tv.tv_sec) * 1000000 + double(tv.tv_usec);
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return double(ts.tv_sec) * 1000000 + double(ts.tv_nsec) / 1000;
     }
 
     inline double get_user_time_usecs() {
@@ -56,6 +60,13 @@ namespace quasi_succinct {
         return double(ru.ru_utime.tv_sec) * 1000000 + double(ru.ru_utime.tv_usec);
     }
 
+    // minor (no I/O) and major page faults of the process so far
+    inline std::pair<uint64_t, uint64_t> get_page_faults() {
+        rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return std::make_pair(uint64_t(ru.ru_minflt), uint64_t(ru.ru_majflt));
+    }
+
     // stolen from folly
     template <class T>
     inline void do_not_optimize_away(T&& datum) {
@@ -71,6 +82,117 @@ namespace quasi_succinct {
         enum { value = sizeof(test<T>(0)) == sizeof(char) };
     };
 
+    // Iterator to use in the inner loops of the encoders. Iterators that own
+    // the data they point to (see compressed_freq_collection) overload it to
+    // return a plain pointer, valid as long as the iterator is alive, so
+    // that the per-element copies do not touch the ownership.
+    template <typename Iterator>
+    Iterator const& unwrap_iterator(Iterator const& it)
+    {
+        return it;
+    }
+
+    // Random-access iterator over a buffer that shares its ownership, for
+    // input collections whose buffers are released once consumed
+    template <typename T>
+    class shared_buffer_iterator
+        : public std::iterator<std::random_access_iterator_tag, T,
+                               std::ptrdiff_t, T const*, T const&> {
+    public:
+        shared_buffer_iterator()
+            : m_ptr(nullptr)
+        {}
+
+        shared_buffer_iterator(std::shared_ptr<void const> const& owner, T const* ptr)
+            : m_owner(owner)
+            , m_ptr(ptr)
+        {}
+
+        T const& operator*() const { return *m_ptr; }
+        T const& operator[](std::ptrdiff_t i) const { return m_ptr[i]; }
+
+        shared_buffer_iterator& operator++() { ++m_ptr; return *this; }
+        shared_buffer_iterator operator++(int) { shared_buffer_iterator it(*this); ++m_ptr; return it; }
+        shared_buffer_iterator& operator--() { --m_ptr; return *this; }
+        shared_buffer_iterator operator--(int) { shared_buffer_iterator it(*this); --m_ptr; return it; }
+        shared_buffer_iterator& operator+=(std::ptrdiff_t i) { m_ptr += i; return *this; }
+        shared_buffer_iterator& operator-=(std::ptrdiff_t i) { m_ptr -= i; return *this; }
+
+        shared_buffer_iterator operator+(std::ptrdiff_t i) const
+        {
+            return shared_buffer_iterator(m_owner, m_ptr + i);
+        }
+
+        shared_buffer_iterator operator-(std::ptrdiff_t i) const
+        {
+            return shared_buffer_iterator(m_owner, m_ptr - i);
+        }
+
+        std::ptrdiff_t operator-(shared_buffer_iterator const& other) const
+        {
+            return m_ptr - other.m_ptr;
+        }
+
+        bool operator==(shared_buffer_iterator const& other) const { return m_ptr == other.m_ptr; }
+        bool operator!=(shared_buffer_iterator const& other) const { return m_ptr != other.m_ptr; }
+        bool operator<(shared_buffer_iterator const& other) const { return m_ptr < other.m_ptr; }
+
+        friend T const* unwrap_iterator(shared_buffer_iterator const& it)
+        {
+            return it.m_ptr;
+        }
+
+    private:
+        std::shared_ptr<void const> m_owner;
+        T const* m_ptr;
+    };
+
+    // Range [begin, end) of a shared buffer, with the interface of
+    // binary_collection::sequence
+    template <typename T>
+    class shared_buffer_sequence {
+    public:
+        typedef shared_buffer_iterator<T> iterator;
+
+        shared_buffer_sequence()
+            : m_begin(nullptr)
+            , m_end(nullptr)
+        {}
+
+        shared_buffer_sequence(std::shared_ptr<void const> const& owner,
+                               T const* begin, T const* end)
+            : m_owner(owner)
+            , m_begin(begin)
+            , m_end(end)
+        {}
+
+        iterator begin() const
+        {
+            return iterator(m_owner, m_begin);
+        }
+
+        iterator end() const
+        {
+            return iterator(m_owner, m_end);
+        }
+
+        T back() const
+        {
+            assert(size());
+            return *(m_end - 1);
+        }
+
+        size_t size() const
+        {
+            return m_end - m_begin;
+        }
+
+    private:
+        std::shared_ptr<void const> m_owner;
+        T const* m_begin;
+        T const* m_end;
+    };
+
     // A more powerful version of boost::function_input_iterator that also works
     // with lambdas.
     //
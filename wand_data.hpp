@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <functional>
+#include <thread>
+
 #include <succinct/mappable_vector.hpp>
 
 #include "binary_freq_collection.hpp"
 #include "bm25.hpp"
+#include "configuration.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -16,56 +24,173 @@ namespace quasi_succinct {
 
         template <typename LengthsIterator>
         wand_data(LengthsIterator len_it, uint64_t num_docs,
-                  binary_freq_collection const& coll)
+                  binary_freq_collection const& coll,
+                  std::vector<uint32_t> threshold_ks = default_threshold_ks(),
+                  size_t norm_len_bits = configuration::get().norm_len_bits)
         {
-            std::vector<float> norm_lens(num_docs);
-            double lens_sum = 0;
-            logger() << "Reading sizes..." << std::endl;
-            for (size_t i = 0; i < num_docs; ++i) {
-                float len = *len_it++;
-                norm_lens[i] = len;
-                lens_sum += len;
-            }
-            float avg_len = float(lens_sum / double(num_docs));
-            for (size_t i = 0; i < num_docs; ++i) {
-                norm_lens[i] /= avg_len;
-            }
+            std::vector<float> norm_lens;
+            read_norm_lens(len_it, num_docs, norm_lens);
+            quantize_norm_lens(norm_lens, norm_len_bits);
+            normalize_threshold_ks(threshold_ks);
 
             logger() << "Storing max weight for each list..." << std::endl;
+            // the lists are independent, so they are processed in batches
+            // by worker_threads threads, each list by a single thread; the
+            // result is the same as with a sequential scan
+            size_t threads = std::max(size_t(1), configuration::get().worker_threads);
             std::vector<float> max_term_weight;
-            for (auto const& seq: coll) {
-                float max_score = 0;
-                for (size_t i = 0; i < seq.docs.size(); ++i) {
-                    uint64_t docid = *(seq.docs.begin() + i);
-                    uint64_t freq = *(seq.freqs.begin() + i);
-                    float score = Scorer::doc_term_weight(freq, norm_lens[docid]);
-                    max_score = std::max(max_score, score);
+            std::vector<float> kth_term_weight;
+            std::vector<binary_freq_collection::sequence> batch;
+            std::vector<list_weights_buffer> buffers(threads);
+            auto it = coll.begin();
+            while (it != coll.end()) {
+                batch.clear();
+                uint64_t batch_postings = 0;
+                for (; it != coll.end() && batch.size() < batch_max_lists &&
+                         batch_postings < batch_max_postings; ++it) {
+                    batch.push_back(*it);
+                    batch_postings += it->docs.size();
                 }
-                max_term_weight.push_back(max_score);
-                if ((max_term_weight.size() % 1000000) == 0) {
+
+                size_t ks = threshold_ks.size();
+                size_t first = max_term_weight.size();
+                max_term_weight.resize(first + batch.size());
+                kth_term_weight.resize((first + batch.size()) * ks);
+
+                run_parallel(batch.size(), buffers, [&](size_t i, list_weights_buffer& buf) {
+                        auto const& seq = batch[i];
+                        list_weights(seq.docs.begin(), seq.freqs.begin(), seq.docs.size(),
+                                     norm_lens, threshold_ks, buf,
+                                     max_term_weight[first + i],
+                                     &kth_term_weight[(first + i) * ks]);
+                    });
+
+                if ((max_term_weight.size() / 1000000) != (first / 1000000)) {
                     logger() << max_term_weight.size() << " list processed" << std::endl;
                 }
             }
             logger() << max_term_weight.size() << " list processed" << std::endl;
 
-            m_norm_lens.steal(norm_lens);
+            if (!m_len_factors.size()) {
+                m_norm_lens.steal(norm_lens);
+            }
             m_max_term_weight.steal(max_term_weight);
+            m_threshold_ks.steal(threshold_ks);
+            m_kth_term_weight.steal(kth_term_weight);
+        }
+
+        // Same as above, but the lists are decoded from an index (a
+        // freq_index or block_freq_index), so that the collection files are
+        // not needed once the index is built. The terms are processed by
+        // worker_threads threads, each decoding one list at a time, so the
+        // memory used is bounded by the longest list per thread. The result
+        // is the same as from the collection the index was built from.
+        //
+        // This overload is only selected for non-collection arguments, as
+        // the one above is more specialized.
+        template <typename LengthsIterator, typename Index>
+        wand_data(LengthsIterator len_it, uint64_t num_docs,
+                  Index const& index,
+                  std::vector<uint32_t> threshold_ks = default_threshold_ks(),
+                  size_t norm_len_bits = configuration::get().norm_len_bits)
+        {
+            std::vector<float> norm_lens;
+            read_norm_lens(len_it, num_docs, norm_lens);
+            quantize_norm_lens(norm_lens, norm_len_bits);
+            normalize_threshold_ks(threshold_ks);
+
+            logger() << "Storing max weight for each list of the index..." << std::endl;
+            size_t threads = std::max(size_t(1), configuration::get().worker_threads);
+            size_t ks = threshold_ks.size();
+            std::vector<float> max_term_weight(index.size());
+            std::vector<float> kth_term_weight(index.size() * ks);
+            std::vector<list_weights_buffer> buffers(threads);
+
+            run_parallel(index.size(), buffers, [&](size_t term, list_weights_buffer& buf) {
+                    auto e = index[term];
+                    size_t n = e.size();
+                    buf.docs.resize(n);
+                    buf.freqs.resize(n);
+                    for (size_t i = 0; i < n; ++i, e.next()) {
+                        buf.docs[i] = uint32_t(e.docid());
+                        buf.freqs[i] = uint32_t(e.freq());
+                    }
+                    list_weights(buf.docs.data(), buf.freqs.data(), n,
+                                 norm_lens, threshold_ks, buf,
+                                 max_term_weight[term], &kth_term_weight[term * ks]);
+                });
+            logger() << max_term_weight.size() << " list processed" << std::endl;
+
+            if (!m_len_factors.size()) {
+                m_norm_lens.steal(norm_lens);
+            }
+            m_max_term_weight.steal(max_term_weight);
+            m_threshold_ks.steal(threshold_ks);
+            m_kth_term_weight.steal(kth_term_weight);
+        }
+
+        static std::vector<uint32_t> default_threshold_ks()
+        {
+            return {10, 100, 1000, 10000};
         }
 
         float norm_len(uint64_t doc_id) const
         {
+            if (m_len_codes8.size()) {
+                return m_quantized_norm_lens[m_len_codes8[doc_id]];
+            } else if (m_len_codes16.size()) {
+                return m_quantized_norm_lens[m_len_codes16[doc_id]];
+            }
             return m_norm_lens[doc_id];
         }
 
+        // Per-document part of the weight (see bm25::len_factor); with
+        // quantized norm lens it is a table lookup
+        float len_factor(uint64_t doc_id) const
+        {
+            if (m_len_codes8.size()) {
+                return m_len_factors[m_len_codes8[doc_id]];
+            } else if (m_len_codes16.size()) {
+                return m_len_factors[m_len_codes16[doc_id]];
+            }
+            return Scorer::len_factor(m_norm_lens[doc_id]);
+        }
+
+        // 0 if the norm lens are stored as floats
+        size_t norm_len_bits() const
+        {
+            if (m_len_codes8.size()) return 8;
+            if (m_len_codes16.size()) return 16;
+            return 0;
+        }
+
         float max_term_weight(uint64_t term_id) const
         {
             return m_max_term_weight[term_id];
         }
 
+        // Returns a weight w such that at least k postings of the term have
+        // doc_term_weight >= w, or 0 if no stored k' >= k is available. The
+        // k' used is the smallest stored one, giving the tightest bound.
+        float kth_term_weight(uint64_t term_id, uint64_t k) const
+        {
+            auto k_it = std::lower_bound(m_threshold_ks.begin(),
+                                         m_threshold_ks.end(), k);
+            if (k_it == m_threshold_ks.end()) return 0;
+            size_t ks = m_threshold_ks.size();
+            return m_kth_term_weight[term_id * ks + (k_it - m_threshold_ks.begin())];
+        }
+
         void swap(wand_data& other)
         {
             m_norm_lens.swap(other.m_norm_lens);
+            m_len_codes8.swap(other.m_len_codes8);
+            m_len_codes16.swap(other.m_len_codes16);
+            m_quantized_norm_lens.swap(other.m_quantized_norm_lens);
+            m_len_factors.swap(other.m_len_factors);
             m_max_term_weight.swap(other.m_max_term_weight);
+            m_threshold_ks.swap(other.m_threshold_ks);
+            m_kth_term_weight.swap(other.m_kth_term_weight);
         }
 
         template <typename Visitor>
@@ -73,13 +198,189 @@ namespace quasi_succinct {
         {
             visit
                 (m_norm_lens, "m_norm_lens")
+                (m_len_codes8, "m_len_codes8")
+                (m_len_codes16, "m_len_codes16")
+                (m_quantized_norm_lens, "m_quantized_norm_lens")
+                (m_len_factors, "m_len_factors")
                 (m_max_term_weight, "m_max_term_weight")
+                (m_threshold_ks, "m_threshold_ks")
+                (m_kth_term_weight, "m_kth_term_weight")
                 ;
         }
 
     private:
+
+        static const size_t batch_max_lists = 1 << 16;
+        static const uint64_t batch_max_postings = 1 << 24;
+
+        struct list_weights_buffer {
+            std::vector<uint32_t> docs;
+            std::vector<uint32_t> freqs;
+            std::vector<float> lens;
+            std::vector<float> scores;
+        };
+
+        template <typename LengthsIterator>
+        static void read_norm_lens(LengthsIterator len_it, uint64_t num_docs,
+                                   std::vector<float>& norm_lens)
+        {
+            norm_lens.resize(num_docs);
+            double lens_sum = 0;
+            logger() << "Reading sizes..." << std::endl;
+            for (size_t i = 0; i < num_docs; ++i) {
+                float len = *len_it++;
+                norm_lens[i] = len;
+                lens_sum += len;
+            }
+            float avg_len = float(lens_sum / double(num_docs));
+            for (size_t i = 0; i < num_docs; ++i) {
+                norm_lens[i] /= avg_len;
+            }
+        }
+
+        // With norm_len_bits = 8 or 16, stores for each document the index
+        // of its norm len in a table of 2^norm_len_bits values, evenly
+        // spaced in log(1 + norm_len), along with the table of the
+        // corresponding len_factors. The norm lens are replaced by the
+        // quantized ones, so that the max weights are upper bounds of the
+        // weights computed at query time.
+        void quantize_norm_lens(std::vector<float>& norm_lens, size_t norm_len_bits)
+        {
+            if (!norm_len_bits) return;
+            if (norm_len_bits != 8 && norm_len_bits != 16) {
+                throw std::invalid_argument("norm_len_bits must be 0, 8 or 16");
+            }
+
+            size_t quanta = size_t(1) << norm_len_bits;
+            float max_log_len = 0;
+            for (auto norm_len: norm_lens) {
+                max_log_len = std::max(max_log_len, std::log1p(norm_len));
+            }
+            float scale = max_log_len > 0 ? float(quanta - 1) / max_log_len : 0;
+
+            std::vector<float> quantized_norm_lens(quanta);
+            std::vector<float> len_factors(quanta);
+            for (size_t q = 0; q < quanta; ++q) {
+                quantized_norm_lens[q] = scale ? std::expm1(float(q) / scale) : 0;
+                len_factors[q] = Scorer::len_factor(quantized_norm_lens[q]);
+            }
+
+            if (norm_len_bits == 8) {
+                std::vector<uint8_t> codes;
+                quantize_codes(norm_lens, scale, quantized_norm_lens, codes);
+                m_len_codes8.steal(codes);
+            } else {
+                std::vector<uint16_t> codes;
+                quantize_codes(norm_lens, scale, quantized_norm_lens, codes);
+                m_len_codes16.steal(codes);
+            }
+            m_quantized_norm_lens.steal(quantized_norm_lens);
+            m_len_factors.steal(len_factors);
+        }
+
+        template <typename Code>
+        static void quantize_codes(std::vector<float>& norm_lens, float scale,
+                                   std::vector<float> const& quantized_norm_lens,
+                                   std::vector<Code>& codes)
+        {
+            codes.resize(norm_lens.size());
+            for (size_t i = 0; i < norm_lens.size(); ++i) {
+                long q = std::lround(std::log1p(norm_lens[i]) * scale);
+                q = std::max(0L, std::min(q, long(quantized_norm_lens.size() - 1)));
+                codes[i] = Code(q);
+                norm_lens[i] = quantized_norm_lens[q];
+            }
+        }
+
+        static void normalize_threshold_ks(std::vector<uint32_t>& threshold_ks)
+        {
+            std::sort(threshold_ks.begin(), threshold_ks.end());
+            threshold_ks.erase(std::unique(threshold_ks.begin(), threshold_ks.end()),
+                               threshold_ks.end());
+        }
+
+        // Calls f(i, buffer) for each i in [0, n), in buffers.size() threads
+        // claiming the indexes in order; each thread has its own buffer
+        template <typename Function>
+        static void run_parallel(size_t n, std::vector<list_weights_buffer>& buffers,
+                                 Function f)
+        {
+            std::atomic<size_t> next(0);
+            auto process = [&](list_weights_buffer& buf) {
+                size_t i;
+                while ((i = next++) < n) {
+                    f(i, buf);
+                }
+            };
+
+            size_t threads = std::min(buffers.size(), n);
+            if (threads <= 1) {
+                process(buffers[0]);
+            } else {
+                std::vector<std::thread> workers;
+                for (size_t t = 0; t < threads; ++t) {
+                    workers.emplace_back(process, std::ref(buffers[t]));
+                }
+                for (auto& worker: workers) {
+                    worker.join();
+                }
+            }
+        }
+
+        // Computes the max weight and the k-th weights of a list. The norm
+        // lens are first gathered into a contiguous buffer, so that the
+        // weights are computed in a branch-free loop over contiguous arrays
+        // that the compiler can vectorize
+        static void list_weights(uint32_t const* docs, uint32_t const* freqs, size_t n,
+                                 std::vector<float> const& norm_lens,
+                                 std::vector<uint32_t> const& threshold_ks,
+                                 list_weights_buffer& buf,
+                                 float& max_score, float* kth_scores)
+        {
+            buf.lens.resize(n);
+            buf.scores.resize(n);
+            float* lens = buf.lens.data();
+            float* scores = buf.scores.data();
+            float const* norm_lens_data = norm_lens.data();
+
+            for (size_t i = 0; i < n; ++i) {
+                lens[i] = norm_lens_data[docs[i]];
+            }
+            for (size_t i = 0; i < n; ++i) {
+                scores[i] = Scorer::doc_term_weight(freqs[i], lens[i]);
+            }
+            max_score = 0;
+            for (size_t i = 0; i < n; ++i) {
+                max_score = std::max(max_score, scores[i]);
+            }
+
+            // k-th highest weight for each k; since the ks are sorted,
+            // each selection only needs to look past the previous one
+            size_t selected = 0;
+            for (size_t j = 0; j < threshold_ks.size(); ++j) {
+                uint64_t k = threshold_ks[j];
+                float kth_score = 0;
+                if (k && k <= n) {
+                    std::nth_element(buf.scores.begin() + selected,
+                                     buf.scores.begin() + (k - 1),
+                                     buf.scores.end(), std::greater<float>());
+                    kth_score = scores[k - 1];
+                    selected = k;
+                }
+                kth_scores[j] = kth_score;
+            }
+        }
+
+        // either m_norm_lens or one of the code vectors is non-empty
         succinct::mapper::mappable_vector<float> m_norm_lens;
+        succinct::mapper::mappable_vector<uint8_t> m_len_codes8;
+        succinct::mapper::mappable_vector<uint16_t> m_len_codes16;
+        succinct::mapper::mappable_vector<float> m_quantized_norm_lens;
+        succinct::mapper::mappable_vector<float> m_len_factors;
         succinct::mapper::mappable_vector<float> m_max_term_weight;
+        succinct::mapper::mappable_vector<uint32_t> m_threshold_ks;
+        // m_threshold_ks.size() weights per term, in term order
+        succinct::mapper::mappable_vector<float> m_kth_term_weight;
     };
 
 }